@@ -0,0 +1,117 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+#include "mpu6500.h"
+#include "fifo_drain.h"
+
+/* Mpu6500 object, SPI bus, CS on pin 10 */
+bfs::Mpu6500 imu(&SPI, 10);
+/* Buffer for a full FIFO of samples */
+bfs::Mpu6500::Sample samples[bfs::FifoDrain::FIFO_FRAMES];
+/* Drain scheduler for the logging path, 1 kHz and a 10 ms latency target */
+bfs::FifoDrain drain;
+static constexpr bfs::FifoDrain::Settings SETTINGS = {
+  1000.0f, 10000.0f, 0.05f, bfs::MpuTiming::Spi(), 5.0f
+};
+/* Control path state, updated by the control step */
+volatile uint32_t num_ctrl = 0;
+volatile float rate_z_radps = 0;
+
+/*
+* Control step, called with the latest sample. This runs in the ISR, or in
+* the logging path when the read was deferred behind a FIFO transfer.
+*/
+void ctrl_step(void *) {
+  num_ctrl = num_ctrl + 1;
+  rate_z_radps = imu.gyro_z_radps();
+}
+
+/* Control path, reads the latest sample from the data registers */
+void imu_isr() {
+  imu.Read();
+}
+
+uint32_t num_logged;
+uint32_t report_us;
+
+void setup() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Set the sample rate divider, 1 kHz */
+  if (!imu.ConfigSrd(0)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  /* Control reads from the registers, logging from the FIFO */
+  if (!imu.EnableDualPath()) {
+    Serial.println("Error enabling dual path mode");
+    while(1) {}
+  }
+  imu.OnControlData(ctrl_step, nullptr);
+  if (!drain.Config(SETTINGS)) {
+    Serial.println("Error configuring the drain scheduler");
+    while(1) {}
+  }
+  /* Enabled data ready interrupt */
+  if (!imu.EnableDrdyInt()) {
+    Serial.println("Error enabling data ready interrupt");
+    while(1) {}
+  }
+  /* Attach data ready interrupt to pin 9 */
+  attachInterrupt(9, imu_isr, RISING);
+  num_logged = 0;
+  report_us = micros();
+}
+
+void loop() {
+  /* Logging path, drains every sample from the FIFO when due */
+  if (drain.Due(micros())) {
+    const size_t num_samples = imu.Read(samples,
+                                        bfs::FifoDrain::FIFO_FRAMES);
+    num_logged += num_samples;
+    drain.Update(micros(), num_samples);
+  }
+  /* Report the sample counts once a second */
+  if (micros() - report_us >= 1000000) {
+    report_us += 1000000;
+    Serial.print("control ");
+    Serial.print(num_ctrl);
+    Serial.print(", deferred ");
+    Serial.print(imu.num_deferred());
+    Serial.print(", logged ");
+    Serial.print(num_logged);
+    Serial.print(", overflows ");
+    Serial.print(drain.point().overflows);
+    Serial.print(", rate z ");
+    Serial.println(rate_z_radps);
+  }
+}
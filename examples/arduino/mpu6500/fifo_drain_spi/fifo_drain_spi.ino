@@ -0,0 +1,101 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu6500.h"
+#include "fifo_drain.h"
+
+/* Mpu6500 object, SPI bus, CS on pin 10 */
+bfs::Mpu6500 imu(&SPI, 10);
+/* Buffer for a full FIFO of samples */
+bfs::Mpu6500::Sample samples[bfs::FifoDrain::FIFO_FRAMES];
+/*
+* Drain scheduler for 1 kHz, a 10 ms latency target, and 5% of the bus and
+* CPU time, with 5 us for each drain besides the transfers
+*/
+bfs::FifoDrain drain;
+static constexpr bfs::FifoDrain::Settings SETTINGS = {
+  1000.0f, 10000.0f, 0.05f, bfs::MpuTiming::Spi(), 5.0f
+};
+
+void Print(const bfs::FifoDrain::OperatingPoint &p) {
+  Serial.print(p.batch_frames);
+  Serial.print(" frames every ");
+  Serial.print(p.interval_us);
+  Serial.print(" us, latency ");
+  Serial.print(p.latency_us);
+  Serial.print(" us, occupancy ");
+  Serial.print(p.occupancy * 100.0f);
+  Serial.print("%, rate ");
+  Serial.print(p.rate_hz);
+  Serial.print(" Hz, jitter ");
+  Serial.print(p.jitter_frames);
+  Serial.print(" frames, overflows ");
+  Serial.print(p.overflows);
+  Serial.println((p.meets_latency && p.meets_budget) ? "" : ", missing target");
+}
+
+uint32_t report_us;
+
+void setup() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Set the sample rate divider, 1 kHz */
+  if (!imu.ConfigSrd(0)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  /* Stream samples to the FIFO */
+  if (!imu.EnableFifo()) {
+    Serial.println("Error enabling FIFO");
+    while(1) {}
+  }
+  if (!drain.Config(SETTINGS)) {
+    Serial.println("Error configuring the drain scheduler");
+    while(1) {}
+  }
+  report_us = micros();
+}
+
+void loop() {
+  /* Drain the FIFO when due, and adjust the interval */
+  if (drain.Due(micros())) {
+    const size_t num_samples = imu.Read(samples,
+                                        bfs::FifoDrain::FIFO_FRAMES);
+    drain.Update(micros(), num_samples);
+  }
+  /* Report the operating point once a second */
+  if (micros() - report_us >= 1000000) {
+    report_us += 1000000;
+    Print(drain.point());
+  }
+}
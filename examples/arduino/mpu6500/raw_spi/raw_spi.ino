@@ -0,0 +1,77 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu6500.h"
+
+/* Mpu6500 object, SPI bus, CS on pin 10 */
+bfs::Mpu6500 imu(&SPI, 10);
+/* Four buffers, each holding up to 18 FIFO frames */
+static constexpr uint8_t NUM_BUFS = 4;
+alignas(4) uint8_t storage[NUM_BUFS][18 * 14];
+bfs::Mpu6500::RawBuffer bufs[NUM_BUFS];
+
+void setup() {
+  /* Serial to log the raw data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Set the sample rate divider, 100 Hz */
+  if (!imu.ConfigSrd(9)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  /* Register the buffers */
+  for (uint8_t i = 0; i < NUM_BUFS; i++) {
+    bufs[i].data = storage[i];
+    bufs[i].size = sizeof(storage[i]);
+  }
+  if (!imu.ConfigRawPool(bufs, NUM_BUFS)) {
+    Serial.println("Error configuring raw buffer pool");
+    while(1) {}
+  }
+  /* Stream samples to the FIFO */
+  if (!imu.EnableFifo()) {
+    Serial.println("Error enabling FIFO");
+    while(1) {}
+  }
+}
+
+void loop() {
+  /* Drain the FIFO into the next free buffer */
+  imu.ReadRaw();
+  /* Log the filled buffers without copying, then hand them back */
+  bfs::Mpu6500::RawBuffer *buf;
+  while ((buf = imu.AcquireRaw()) != nullptr) {
+    Serial.write(buf->data, buf->len);
+    imu.ReleaseRaw(buf);
+  }
+  delay(100);
+}
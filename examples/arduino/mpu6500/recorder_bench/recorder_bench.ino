@@ -0,0 +1,157 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Records a minute of synthetic 1 kHz MPU-6500 data into a compressed
+* flight recorder, freezes it, and exports and decodes the blocks, checking
+* them against the data. Reports the compression, the seconds of history
+* held, and the time per sample. No sensor is needed.
+*/
+
+#include <math.h>
+#include "flight_recorder.h"
+#include "mpu_batch.h"
+#include "mpu_synth.h"
+
+/* 160 KiB holds over 30 s at 1 kHz, 420 KB uncompressed */
+static constexpr size_t BUF_SIZE = 160 * 1024;
+static constexpr size_t NUM_SAMPLES = 60000;
+static constexpr float RATE_HZ = 1000.0f;
+/* Per count scales for the +/-16g and +/-2000 deg/s ranges */
+static constexpr float ACCEL_SCALE = bfs::AccelScaleMps2(16.0f);
+static constexpr float GYRO_SCALE = bfs::GyroScaleRadps(2000.0f);
+/* MPU-6500 noise density times the root of the 184 Hz bandwidth */
+static constexpr bfs::ImuNoise NOISE = {
+  0.04f, 0.0024f, 0.0f,
+  0.0005f, 0.00005f,
+  0.002f, 0.0003f, 25.0f
+};
+uint8_t buf[BUF_SIZE];
+bfs::FlightRecorder recorder;
+bfs::ImuSynth synth;
+/* Decoding state: the replayed data and the samples checked */
+bfs::ImuSynth replay;
+uint32_t next_sample;
+uint32_t num_checked;
+uint32_t num_errors;
+
+/* Gentle maneuvering with a 1 C per minute warm up */
+void Flight(const double t_s, bfs::TrajectoryPoint * const point,
+            void *) {
+  const float t = static_cast<float>(t_s);
+  point->gyro_radps[0] = 0.4f * sinf(0.5f * t);
+  point->gyro_radps[1] = 0.2f * sinf(0.3f * t);
+  point->gyro_radps[2] = 0.1f * cosf(0.2f * t);
+  point->accel_ned_mps2[0] = 1.0f * sinf(0.1f * t);
+  point->accel_ned_mps2[1] = 0.0f;
+  point->accel_ned_mps2[2] = 0.5f * sinf(0.7f * t);
+  point->die_temp_c = 30.0f + t / 60.0f;
+}
+
+void Frame(bfs::ImuSynth * const s, uint8_t * const frame) {
+  bfs::ImuValues v;
+  s->Step(nullptr, &v);
+  bfs::PackImuFrame(v, ACCEL_SCALE, GYRO_SCALE, frame);
+}
+
+/* Decodes each exported block and checks it against the replayed data */
+bool Check(const uint8_t * const block, const size_t len, void *) {
+  int16_t cnts[bfs::FlightRecorder::BLOCK_SAMPLES][bfs::FlightRecorder::NUM_CH];
+  uint32_t first;
+  const size_t num = bfs::FlightRecorder::DecodeBlock(
+    block, len, cnts, bfs::FlightRecorder::BLOCK_SAMPLES, &first);
+  if (!num) {return false;}
+  uint8_t frame[bfs::IMU_FRAME_SIZE];
+  while (next_sample < first) {
+    Frame(&replay, frame);
+    next_sample++;
+  }
+  for (size_t i = 0; i < num; i++) {
+    Frame(&replay, frame);
+    next_sample++;
+    for (size_t ch = 0; ch < bfs::FlightRecorder::NUM_CH; ch++) {
+      const int16_t ref = static_cast<int16_t>(frame[2 * ch]) << 8 |
+                          frame[2 * ch + 1];
+      if (cnts[i][ch] != ref) {num_errors++;}
+    }
+    num_checked++;
+  }
+  return true;
+}
+
+void Benchmark() {
+  recorder.Config(buf, sizeof(buf));
+  synth.Config(Flight, nullptr, RATE_HZ);
+  synth.ConfigNoise(NOISE, 11);
+  uint8_t frame[bfs::IMU_FRAME_SIZE];
+  uint32_t total_us = 0, max_us = 0;
+  for (size_t i = 0; i < NUM_SAMPLES; i++) {
+    Frame(&synth, frame);
+    const uint32_t t0 = micros();
+    recorder.AddFrame(frame);
+    const uint32_t dt = micros() - t0;
+    total_us += dt;
+    if (dt > max_us) {max_us = dt;}
+  }
+  recorder.Freeze();
+  const uint32_t num = recorder.num_samples();
+  Serial.print("Held: ");
+  Serial.print(num / RATE_HZ);
+  Serial.print(" s in ");
+  Serial.print(recorder.bytes_used());
+  Serial.print(" bytes, ");
+  Serial.print(static_cast<float>(recorder.bytes_used()) / num);
+  Serial.print(" bytes / sample, ");
+  Serial.print(static_cast<float>(num) * bfs::IMU_FRAME_SIZE /
+               recorder.bytes_used());
+  Serial.println(" times smaller than raw");
+  Serial.print("Add: ");
+  Serial.print(static_cast<float>(total_us) / NUM_SAMPLES);
+  Serial.print(" us mean, ");
+  Serial.print(max_us);
+  Serial.println(" us max");
+  /* Export the frozen history, decoding and checking each block */
+  replay.Config(Flight, nullptr, RATE_HZ);
+  replay.ConfigNoise(NOISE, 11);
+  next_sample = 0;
+  num_checked = 0;
+  num_errors = 0;
+  const bool status = recorder.Export(Check, nullptr);
+  Serial.print("Export: ");
+  Serial.print(status ? "decoded " : "failed, decoded ");
+  Serial.print(num_checked);
+  Serial.print(" samples, ");
+  Serial.print(num_errors);
+  Serial.println(" errors");
+}
+
+void setup() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  Benchmark();
+}
+
+void loop() {}
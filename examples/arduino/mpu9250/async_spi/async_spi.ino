@@ -0,0 +1,128 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/* Requires C++20 coroutine support, i.e. -std=c++20 */
+#include "mpu_async.h"
+
+/* Minimal cooperative scheduler, resuming coroutines after their sleep */
+class Scheduler {
+ public:
+  struct Sleeper {
+    Scheduler *sched;
+    uint32_t ms;
+    bool await_ready() const {return false;}
+    void await_suspend(std::coroutine_handle<> h) {sched->Add(h, ms);}
+    void await_resume() const {}
+  };
+  Sleeper Sleep(const uint32_t ms) {return {this, ms};}
+  void Add(const std::coroutine_handle<> h, const uint32_t ms) {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+      if (!slots_[i].handle) {
+        slots_[i].handle = h;
+        slots_[i].start_ms = millis();
+        slots_[i].ms = ms;
+        return;
+      }
+    }
+  }
+  void Poll() {
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+      if ((slots_[i].handle) &&
+          (millis() - slots_[i].start_ms >= slots_[i].ms)) {
+        std::coroutine_handle<> h = slots_[i].handle;
+        slots_[i].handle = nullptr;
+        h.resume();
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t MAX_TASKS = 8;
+  struct Slot {
+    std::coroutine_handle<> handle;
+    uint32_t start_ms;
+    uint32_t ms;
+  } slots_[MAX_TASKS];
+};
+Scheduler sched;
+
+/* Four Mpu9250 on the SPI bus, CS on pins 10, 9, 8, and 7 */
+bfs::Mpu9250 imu0(&SPI, 10), imu1(&SPI, 9), imu2(&SPI, 8), imu3(&SPI, 7);
+bfs::Mpu9250 * const imu[] = {&imu0, &imu1, &imu2, &imu3};
+
+/* Initializes and configures one IMU, suspending on each delay */
+bfs::MpuTask<bool> StartImu(bfs::Mpu9250 * const dev) {
+  bool status = co_await bfs::MpuAsync::Begin(*dev, sched);
+  if (!status) {co_return false;}
+  status = co_await bfs::MpuAsync::ConfigSrd(*dev, 19, sched);
+  co_return status;
+}
+
+void setup() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Start all of the IMUs concurrently */
+  bfs::MpuTask<bool> task[] = {StartImu(imu[0]), StartImu(imu[1]),
+                               StartImu(imu[2]), StartImu(imu[3])};
+  uint32_t t0 = millis();
+  for (size_t i = 0; i < 4; i++) {
+    task[i].Start();
+  }
+  bool done = false;
+  while (!done) {
+    sched.Poll();
+    done = true;
+    for (size_t i = 0; i < 4; i++) {
+      done = done && task[i].done();
+    }
+  }
+  Serial.print("Startup time, ms: ");
+  Serial.println(millis() - t0);
+  for (size_t i = 0; i < 4; i++) {
+    if (!task[i].result()) {
+      Serial.print("Error initializing IMU ");
+      Serial.println(i);
+      while(1) {}
+    }
+  }
+}
+
+void loop() {
+  for (size_t i = 0; i < 4; i++) {
+    if (imu[i]->Read()) {
+      Serial.print(i);
+      Serial.print("\t");
+      Serial.print(imu[i]->accel_x_mps2());
+      Serial.print("\t");
+      Serial.print(imu[i]->accel_y_mps2());
+      Serial.print("\t");
+      Serial.print(imu[i]->accel_z_mps2());
+      Serial.print("\n");
+    }
+  }
+}
@@ -0,0 +1,169 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Compares the compact sample formats on synthetic MPU-9250 data: float,
+* int16 with a shared scale per channel group, and fp16. Reports the bytes
+* per sample, the history that fits in 16 KiB, the largest and RMS error of
+* each format, and the pack and unpack time. No sensor is needed.
+*/
+
+#include <math.h>
+#include "mpu_batch.h"
+#include "mpu_synth.h"
+
+/* Samples per run and runs for timing */
+static constexpr size_t NUM_SAMPLES = 512;
+static constexpr size_t NUM_RUNS = 20;
+/* Accel, gyro, and mag, 3 channels each */
+static constexpr size_t NUM_GROUPS = 3;
+static constexpr size_t NUM_VALS = NUM_SAMPLES * 3;
+static constexpr float RATE_HZ = 1000.0f;
+static constexpr size_t HISTORY_BYTES = 16384;
+/* Shared int16 scales: the +/-16g and +/-2000 deg/s ranges, AK8963 16 bit */
+static constexpr float SCALE[NUM_GROUPS] = {
+  bfs::AccelScaleMps2(16.0f),
+  bfs::GyroScaleRadps(2000.0f),
+  4912.0f / 32760.0f
+};
+static const char * const NAME[NUM_GROUPS] = {"accel", "gyro", "mag"};
+static const char * const UNIT[NUM_GROUPS] = {"m/s/s", "rad/s", "uT"};
+/* Values interleaved x, y, z per group, in each format */
+bfs::ImuSynth synth;
+float vals[NUM_GROUPS][NUM_VALS];
+int16_t vals16[NUM_GROUPS][NUM_VALS];
+uint16_t valsfp16[NUM_GROUPS][NUM_VALS];
+float out[NUM_GROUPS][NUM_VALS];
+
+/* Fast tumbling with vibration and a lateral oscillation */
+void Vibration(const double t_s, bfs::TrajectoryPoint * const point,
+               void *) {
+  const float t = static_cast<float>(t_s);
+  point->gyro_radps[0] = 3.0f * sinf(6.2831853f * 3.0f * t);
+  point->gyro_radps[1] = 1.5f * cosf(6.2831853f * 1.3f * t);
+  point->gyro_radps[2] = 0.5f;
+  point->accel_ned_mps2[0] = 20.0f * sinf(6.2831853f * 40.0f * t);
+  point->accel_ned_mps2[1] = 5.0f * sinf(6.2831853f * t);
+  point->accel_ned_mps2[2] = 2.0f * cosf(6.2831853f * 25.0f * t);
+  point->die_temp_c = 30.0f;
+}
+
+void Report(const char *format, const size_t bytes) {
+  Serial.print(format);
+  Serial.print(": ");
+  Serial.print(bytes);
+  Serial.print(" bytes / sample, ");
+  Serial.print(static_cast<float>(HISTORY_BYTES / bytes) / RATE_HZ);
+  Serial.println(" s of history in 16 KiB at 1 kHz");
+  for (size_t g = 0; g < NUM_GROUPS; g++) {
+    float max_err = 0.0f, sum_sq = 0.0f;
+    for (size_t i = 0; i < NUM_VALS; i++) {
+      const float e = fabsf(out[g][i] - vals[g][i]);
+      if (e > max_err) {max_err = e;}
+      sum_sq += e * e;
+    }
+    Serial.print("  ");
+    Serial.print(NAME[g]);
+    Serial.print(" max error ");
+    Serial.print(max_err * 1e6f);
+    Serial.print(", RMS ");
+    Serial.print(sqrtf(sum_sq / NUM_VALS) * 1e6f);
+    Serial.print(" micro ");
+    Serial.println(UNIT[g]);
+  }
+}
+
+void Timing(const uint32_t pack_us, const uint32_t unpack_us) {
+  const float num = static_cast<float>(NUM_RUNS * NUM_GROUPS * NUM_VALS);
+  Serial.print("  pack ");
+  Serial.print(pack_us * 1000.0f / num);
+  Serial.print(" ns / value, unpack ");
+  Serial.print(unpack_us * 1000.0f / num);
+  Serial.println(" ns / value");
+}
+
+void Benchmark() {
+  synth.Config(Vibration, nullptr, RATE_HZ);
+  synth.ConfigNoise({0.03f, 0.0017f, 0.6f, 0.0005f, 0.00005f, 0, 0, 25}, 9);
+  const float mag_ned[3] = {20.7f, 3.2f, 47.5f};
+  synth.ConfigMagField(mag_ned);
+  bfs::ImuValues v;
+  for (size_t i = 0; i < NUM_SAMPLES; i++) {
+    synth.Step(nullptr, &v);
+    for (size_t k = 0; k < 3; k++) {
+      vals[0][3 * i + k] = v.accel_mps2[k];
+      vals[1][3 * i + k] = v.gyro_radps[k];
+      vals[2][3 * i + k] = v.mag_ut[k];
+    }
+  }
+  /* Float, 9 values and the die temperature, stored exactly */
+  for (size_t g = 0; g < NUM_GROUPS; g++) {
+    for (size_t i = 0; i < NUM_VALS; i++) {
+      out[g][i] = vals[g][i];
+    }
+  }
+  Report("float", 10 * sizeof(float));
+  /* Int16, with the 3 scales stored once per buffer */
+  uint32_t t0 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    for (size_t g = 0; g < NUM_GROUPS; g++) {
+      bfs::PackInt16(vals[g], NUM_VALS, SCALE[g], vals16[g]);
+    }
+  }
+  uint32_t t1 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    for (size_t g = 0; g < NUM_GROUPS; g++) {
+      bfs::UnpackInt16(vals16[g], NUM_VALS, SCALE[g], out[g]);
+    }
+  }
+  uint32_t t2 = micros();
+  Report("int16", 10 * sizeof(int16_t));
+  Timing(t1 - t0, t2 - t1);
+  /* Fp16 */
+  t0 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    for (size_t g = 0; g < NUM_GROUPS; g++) {
+      bfs::PackFp16(vals[g], NUM_VALS, valsfp16[g]);
+    }
+  }
+  t1 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    for (size_t g = 0; g < NUM_GROUPS; g++) {
+      bfs::UnpackFp16(valsfp16[g], NUM_VALS, out[g]);
+    }
+  }
+  t2 = micros();
+  Report("fp16", 10 * sizeof(uint16_t));
+  Timing(t1 - t0, t2 - t1);
+}
+
+void setup() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  Benchmark();
+}
+
+void loop() {}
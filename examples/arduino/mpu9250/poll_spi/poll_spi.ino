@@ -0,0 +1,98 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu9250.h"
+
+/* Mpu9250 object, SPI bus, CS on pin 10 */
+bfs::Mpu9250 imu(&SPI, 10);
+
+/* Sensor state, advanced from the superloop */
+enum State {
+  INIT,
+  CONFIG,
+  RUN
+};
+State state = INIT;
+/* Number of loops, standing in for the rest of the system */
+uint32_t loops = 0;
+
+void setup() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Start initializing the IMU, this returns immediately */
+  imu.StartBegin();
+}
+
+void loop() {
+  loops++;
+  switch (state) {
+    case INIT: {
+      bfs::Mpu9250::PollStatus status = imu.Poll();
+      if (status == bfs::Mpu9250::POLL_FAILED) {
+        Serial.println("Error initializing communication with IMU");
+        while(1) {}
+      }
+      if (status == bfs::Mpu9250::POLL_DONE) {
+        Serial.print("Initialized, loops: ");
+        Serial.println(loops);
+        /* Set the sample rate divider */
+        imu.StartConfigSrd(19);
+        state = CONFIG;
+      }
+      break;
+    }
+    case CONFIG: {
+      bfs::Mpu9250::PollStatus status = imu.Poll();
+      if (status == bfs::Mpu9250::POLL_FAILED) {
+        Serial.println("Error configured SRD");
+        while(1) {}
+      }
+      if (status == bfs::Mpu9250::POLL_DONE) {
+        state = RUN;
+      }
+      break;
+    }
+    case RUN: {
+      if (imu.Read()) {
+        Serial.print(imu.accel_x_mps2());
+        Serial.print("\t");
+        Serial.print(imu.accel_y_mps2());
+        Serial.print("\t");
+        Serial.print(imu.accel_z_mps2());
+        Serial.print("\t");
+        Serial.print(imu.mag_x_ut());
+        Serial.print("\t");
+        Serial.print(imu.mag_y_ut());
+        Serial.print("\t");
+        Serial.print(imu.mag_z_ut());
+        Serial.print("\n");
+      }
+      break;
+    }
+  }
+}
@@ -0,0 +1,142 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Generates synthetic MPU-9250 data from a coning trajectory, encodes it into
+* register data, and decodes it again with UnpackImuFrames to check the
+* round trip. Reports the generation rate against real time at 1 kHz. No
+* sensor is needed.
+*/
+
+#include <math.h>
+#include "mpu_synth.h"
+#include "mpu_batch.h"
+
+/* Samples per block and blocks to generate, 10 s at 1 kHz */
+static constexpr size_t NUM_SAMPLES = 250;
+static constexpr size_t NUM_BLOCKS = 40;
+static constexpr float RATE_HZ = 1000.0f;
+/* Per count scales for the +/-16g and +/-2000 deg/s ranges */
+static constexpr float ACCEL_SCALE = bfs::AccelScaleMps2(16.0f);
+static constexpr float GYRO_SCALE = bfs::GyroScaleRadps(2000.0f);
+/* AK8963 16 bit scale with a sensitivity adjustment of 128 */
+static constexpr float MAG_SCALE = 4912.0f / 32760.0f;
+/* Typical MPU-9250 noise, bias instability, and temperature drift */
+static constexpr bfs::ImuNoise NOISE = {
+  0.03f, 0.0017f, 0.6f,
+  0.0005f, 0.00005f,
+  0.002f, 0.0003f, 25.0f
+};
+/* Earth field near Boulder, CO, in NED */
+static constexpr float MAG_NED_UT[3] = {20.7f, 3.2f, 47.5f};
+/* Encoded frames, measured values, and the decoded output */
+bfs::ImuSynth synth;
+uint8_t frames[NUM_SAMPLES * bfs::IMU_FRAME_SIZE];
+uint8_t mag_data[NUM_SAMPLES][8];
+bfs::ImuValues measured[NUM_SAMPLES];
+float ax[NUM_SAMPLES], ay[NUM_SAMPLES], az[NUM_SAMPLES];
+float gx[NUM_SAMPLES], gy[NUM_SAMPLES], gz[NUM_SAMPLES];
+float temp[NUM_SAMPLES];
+bfs::ImuFrameArrays out = {ax, ay, az, gx, gy, gz, temp};
+
+/* Coning at 2 Hz with a 1 Hz lateral oscillation, warming 1 C per second */
+void Coning(const double t_s, bfs::TrajectoryPoint * const point,
+            void *) {
+  const float w = 6.2831853f * 2.0f;
+  const float t = static_cast<float>(t_s);
+  point->gyro_radps[0] = 0.5f * cosf(w * t);
+  point->gyro_radps[1] = 0.5f * sinf(w * t);
+  point->gyro_radps[2] = 0.1f;
+  point->accel_ned_mps2[0] = 0.0f;
+  point->accel_ned_mps2[1] = 2.0f * sinf(6.2831853f * t);
+  point->accel_ned_mps2[2] = 0.0f;
+  point->die_temp_c = 25.0f + t;
+}
+
+/* Largest decoding error, in counts */
+float Check(const float val, const float ref, const float scale,
+            const float err) {
+  const float e = fabsf(val - ref) / scale;
+  return (e > err) ? e : err;
+}
+
+void Benchmark() {
+  synth.Config(Coning, nullptr, RATE_HZ);
+  synth.ConfigNoise(NOISE, 42);
+  synth.ConfigMagField(MAG_NED_UT);
+  const float mag_scale[3] = {MAG_SCALE, MAG_SCALE, MAG_SCALE};
+  float err = 0.0f;
+  uint32_t gen_us = 0;
+  for (size_t b = 0; b < NUM_BLOCKS; b++) {
+    uint32_t t0 = micros();
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+      synth.Step(nullptr, &measured[i]);
+      bfs::PackImuFrame(measured[i], ACCEL_SCALE, GYRO_SCALE,
+                        frames + i * bfs::IMU_FRAME_SIZE);
+      bfs::PackMagData(measured[i].mag_ut, mag_scale, mag_data[i]);
+    }
+    gen_us += micros() - t0;
+    /* Decode and compare, every value is within half a count */
+    bfs::UnpackImuFrames(frames, NUM_SAMPLES, ACCEL_SCALE, GYRO_SCALE, &out);
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+      const bfs::ImuValues &m = measured[i];
+      err = Check(ax[i], m.accel_mps2[0], ACCEL_SCALE, err);
+      err = Check(ay[i], m.accel_mps2[1], ACCEL_SCALE, err);
+      err = Check(az[i], m.accel_mps2[2], ACCEL_SCALE, err);
+      err = Check(gx[i], m.gyro_radps[0], GYRO_SCALE, err);
+      err = Check(gy[i], m.gyro_radps[1], GYRO_SCALE, err);
+      err = Check(gz[i], m.gyro_radps[2], GYRO_SCALE, err);
+      for (size_t k = 0; k < 3; k++) {
+        const int16_t cnt = static_cast<int16_t>(mag_data[i][2 + 2 * k]) << 8 |
+                            mag_data[i][1 + 2 * k];
+        err = Check(cnt * MAG_SCALE, m.mag_ut[k], MAG_SCALE, err);
+      }
+    }
+  }
+  const float num = static_cast<float>(NUM_BLOCKS * NUM_SAMPLES);
+  Serial.print("Generate and encode: ");
+  Serial.print(gen_us * 1000.0f / num);
+  Serial.println(" ns / sample");
+  Serial.print("Real time factor at 1 kHz: ");
+  Serial.println(num / RATE_HZ / (gen_us * 1e-6f));
+  Serial.print("Largest round trip error: ");
+  Serial.print(err);
+  Serial.println(" counts");
+  Serial.print("Final accel: ");
+  Serial.print(ax[NUM_SAMPLES - 1]);
+  Serial.print("\t");
+  Serial.print(ay[NUM_SAMPLES - 1]);
+  Serial.print("\t");
+  Serial.println(az[NUM_SAMPLES - 1]);
+}
+
+void setup() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  Benchmark();
+}
+
+void loop() {}
@@ -0,0 +1,163 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2021 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+/*
+* Requires INVENSENSE_IMU_FAULT_INJECTION. Streams at 1 kHz through phases of
+* injected bus faults and reports the data throughput, the repeated samples
+* left by stuck values, and the time taken to recover from a device reset.
+*/
+
+#include "mpu6500.h"
+
+/* Mpu6500 object, SPI bus, CS on pin 10 */
+bfs::Mpu6500 imu(&SPI, 10);
+/* Fault injector */
+bfs::FaultInjector faults;
+/* Duration of each phase */
+static constexpr uint32_t PHASE_MS = 10000;
+/* Time without a new sample before the sensor is re-initialized */
+static constexpr uint32_t RECOVERY_TIMEOUT_MS = 20;
+/* Fault rates per transfer, in parts per million */
+struct Phase {
+  const char *name;
+  bfs::FaultInjector::Rates rates;
+};
+static constexpr Phase PHASES[] = {
+  {"None",       {0,    0,    0,    0,   0,  0}},
+  {"NACK",       {1000, 0,    0,    0,   0,  0}},
+  {"Short read", {0,    1000, 0,    0,   0,  0}},
+  {"Bit flip",   {0,    0,    1000, 0,   0,  0}},
+  {"Stuck",      {0,    0,    0,    100, 0,  50}},
+  {"Reset",      {0,    0,    0,    0,   20, 0}},
+  {"All",        {1000, 1000, 1000, 100, 20, 50}}
+};
+
+/* Initializes the sensor for 1 kHz data, retrying until it succeeds */
+void Init() {
+  while (!imu.Begin() || !imu.ConfigSrd(0)) {}
+}
+
+/* Runs one phase and returns its throughput, in samples per second */
+float RunPhase(const Phase &phase, const float baseline) {
+  faults.Config(phase.rates);
+  faults.ClearCounts();
+  uint32_t calls = 0, samples = 0, repeats = 0;
+  uint32_t recoveries = 0, recovery_ms = 0, max_recovery_ms = 0;
+  float prev[6] = {};
+  bool recovering = false;
+  const uint32_t t0 = millis();
+  uint32_t t_good = t0;
+  while (millis() - t0 < PHASE_MS) {
+    calls++;
+    if (imu.Read()) {
+      samples++;
+      const float cur[6] = {imu.accel_x_mps2(), imu.accel_y_mps2(),
+                            imu.accel_z_mps2(), imu.gyro_x_radps(),
+                            imu.gyro_y_radps(), imu.gyro_z_radps()};
+      /* Sensor noise makes an exact repeat the sign of a stuck value */
+      bool repeat = true;
+      for (int i = 0; i < 6; i++) {
+        repeat = repeat && (cur[i] == prev[i]);
+        prev[i] = cur[i];
+      }
+      if (repeat) {repeats++;}
+      if (recovering) {
+        const uint32_t dt = millis() - t_good;
+        recovery_ms += dt;
+        if (dt > max_recovery_ms) {max_recovery_ms = dt;}
+        recovering = false;
+      }
+      t_good = millis();
+    } else if (millis() - t_good > RECOVERY_TIMEOUT_MS) {
+      /* The sensor stopped sampling, e.g. after a reset */
+      if (!recovering) {recoveries++;}
+      recovering = true;
+      Init();
+    }
+  }
+  const float rate = samples * 1000.0f / PHASE_MS;
+  const bfs::FaultInjector::Counts &c = faults.counts();
+  Serial.print(phase.name);
+  Serial.print(": ");
+  Serial.print(calls);
+  Serial.print(" reads, ");
+  Serial.print(rate);
+  Serial.print(" samples/s");
+  if (baseline > 0.0f) {
+    Serial.print(", ");
+    Serial.print(100.0f * (1.0f - rate / baseline));
+    Serial.print("% loss");
+  }
+  Serial.print(", ");
+  Serial.print(repeats);
+  Serial.print(" repeats, ");
+  Serial.print(recoveries);
+  Serial.print(" recoveries");
+  if (recoveries > 0) {
+    Serial.print(" (mean ");
+    Serial.print(static_cast<float>(recovery_ms) / recoveries);
+    Serial.print(" ms, max ");
+    Serial.print(max_recovery_ms);
+    Serial.print(" ms)");
+  }
+  Serial.print("\n  injected over ");
+  Serial.print(c.transfers);
+  Serial.print(" transfers: ");
+  Serial.print(c.nack);
+  Serial.print(" NACK, ");
+  Serial.print(c.short_read);
+  Serial.print(" short, ");
+  Serial.print(c.bit_flip);
+  Serial.print(" flip, ");
+  Serial.print(c.stuck);
+  Serial.print(" stuck, ");
+  Serial.print(c.reset);
+  Serial.println(" reset");
+  return rate;
+}
+
+int main() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU without faults */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  if (!imu.ConfigSrd(0)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  imu.ConfigFaults(&faults);
+  float baseline = 0.0f;
+  for (const Phase &phase : PHASES) {
+    const float rate = RunPhase(phase, baseline);
+    if (baseline == 0.0f) {baseline = rate;}
+  }
+  imu.ConfigFaults(nullptr);
+  while(1) {}
+}
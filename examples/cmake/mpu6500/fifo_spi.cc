@@ -0,0 +1,76 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu6500.h"
+
+/* Mpu6500 object, SPI bus, CS on pin 10 */
+bfs::Mpu6500 imu(&SPI, 10);
+/* Buffer for a full FIFO of samples */
+bfs::Mpu6500::Sample samples[36];
+
+int main() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Set the sample rate divider, 100 Hz */
+  if (!imu.ConfigSrd(9)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  /* Stream samples to the FIFO */
+  if (!imu.EnableFifo()) {
+    Serial.println("Error enabling FIFO");
+    while(1) {}
+  }
+  while(1) {
+    /* Read all of the available samples */
+    size_t num_samples = imu.Read(samples, 36);
+    for (size_t i = 0; i < num_samples; i++) {
+      Serial.print(samples[i].accel_x_mps2);
+      Serial.print("\t");
+      Serial.print(samples[i].accel_y_mps2);
+      Serial.print("\t");
+      Serial.print(samples[i].accel_z_mps2);
+      Serial.print("\t");
+      Serial.print(samples[i].gyro_x_radps);
+      Serial.print("\t");
+      Serial.print(samples[i].gyro_y_radps);
+      Serial.print("\t");
+      Serial.print(samples[i].gyro_z_radps);
+      Serial.print("\t");
+      Serial.print(samples[i].die_temp_c);
+      Serial.print("\n");
+    }
+    /* Process the samples in batches */
+    delay(100);
+  }
+}
@@ -0,0 +1,112 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include "mpu_batch.h"
+
+/* Frames to convert per run, a full FIFO is 36 frames */
+static constexpr size_t NUM_FRAMES = 252;
+static constexpr size_t NUM_RUNS = 100;
+/* Per count scales for the +/-16g and +/-2000 deg/s ranges */
+static constexpr float ACCEL_SCALE = bfs::AccelScaleMps2(16.0f);
+static constexpr float GYRO_SCALE = bfs::GyroScaleRadps(2000.0f);
+/* Synthetic raw frames and the converted output */
+uint8_t frames[NUM_FRAMES * bfs::IMU_FRAME_SIZE];
+float ax[NUM_FRAMES], ay[NUM_FRAMES], az[NUM_FRAMES];
+float gx[NUM_FRAMES], gy[NUM_FRAMES], gz[NUM_FRAMES];
+float temp[NUM_FRAMES];
+bfs::ImuFrameArrays out = {ax, ay, az, gx, gy, gz, temp};
+/* Reference output of the per frame code, compared with the batch output */
+static constexpr size_t NUM_CH = 7;
+float ref[NUM_CH][NUM_FRAMES];
+float * const batch_ch[NUM_CH] = {ax, ay, az, gx, gy, gz, temp};
+
+/* One frame at a time, using the same shift-or code as Read */
+void UnpackPerFrame() {
+  for (size_t i = 0; i < NUM_FRAMES; i++) {
+    const uint8_t *p = frames + i * bfs::IMU_FRAME_SIZE;
+    int16_t cnts[7];
+    for (size_t ch = 0; ch < 7; ch++) {
+      cnts[ch] = static_cast<int16_t>(p[2 * ch]) << 8 | p[2 * ch + 1];
+    }
+    ref[0][i] = static_cast<float>(cnts[1]) * ACCEL_SCALE;
+    ref[1][i] = static_cast<float>(cnts[0]) * ACCEL_SCALE;
+    ref[2][i] = static_cast<float>(cnts[2]) * -ACCEL_SCALE;
+    ref[3][i] = static_cast<float>(cnts[5]) * GYRO_SCALE;
+    ref[4][i] = static_cast<float>(cnts[4]) * GYRO_SCALE;
+    ref[5][i] = static_cast<float>(cnts[6]) * -GYRO_SCALE;
+    ref[6][i] = (static_cast<float>(cnts[3]) - 21.0f) / 333.87f + 21.0f;
+  }
+}
+
+void Benchmark() {
+  /* Fill the frames with a repeatable pattern */
+  for (size_t i = 0; i < sizeof(frames); i++) {
+    frames[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+  uint32_t t0 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    UnpackPerFrame();
+  }
+  uint32_t t1 = micros();
+  for (size_t run = 0; run < NUM_RUNS; run++) {
+    bfs::UnpackImuFrames(frames, NUM_FRAMES, ACCEL_SCALE, GYRO_SCALE, &out);
+  }
+  uint32_t t2 = micros();
+  /* Time per frame, in nanoseconds */
+  Serial.print("Per frame: ");
+  Serial.print((t1 - t0) * 1000.0f / (NUM_RUNS * NUM_FRAMES));
+  Serial.println(" ns / frame");
+  Serial.print("Batch: ");
+  Serial.print((t2 - t1) * 1000.0f / (NUM_RUNS * NUM_FRAMES));
+  Serial.println(" ns / frame");
+  /*
+  * Compare every value, covering the vector loop and the scalar tail. The
+  * batch temperature uses a gain and offset, so allow for rounding.
+  */
+  size_t mismatches = 0;
+  float max_err = 0.0f;
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    for (size_t i = 0; i < NUM_FRAMES; i++) {
+      const float err = fabsf(batch_ch[ch][i] - ref[ch][i]);
+      if (err > max_err) {max_err = err;}
+      if (err > 1e-5f * (1.0f + fabsf(ref[ch][i]))) {mismatches++;}
+    }
+  }
+  Serial.print("Mismatches: ");
+  Serial.print(mismatches);
+  Serial.print(" of ");
+  Serial.print(NUM_CH * NUM_FRAMES);
+  Serial.print(", max error ");
+  Serial.println(max_err);
+}
+
+int main() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  Benchmark();
+  while(1) {}
+}
@@ -0,0 +1,75 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2021 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+/*
+* Checks whether four MPU-9250 sampling at 1 kHz fit on one I2C bus at
+* 400 kHz or need SPI, using the bus timing model. No sensor is needed.
+*/
+
+#include "mpu_timing.h"
+
+using bfs::MpuTiming;
+
+/* Four sensors, SRD of 0 for 1 kHz, FIFO drained at 100 Hz */
+static constexpr size_t NUM_IMU = 4;
+static constexpr uint8_t SRD = 0;
+static constexpr float DRAIN_HZ = 100.0f;
+
+/* The SPI configuration is checked when compiling */
+static_assert(MpuTiming::Snapshot<bfs::Mpu9250>(MpuTiming::Spi(), NUM_IMU,
+                                                SRD).fits,
+              "Four MPU-9250 at 1 kHz do not fit on SPI");
+
+void Print(const char *name, const MpuTiming::Load &load) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(load.occupancy * 100.0f);
+  Serial.print("% bus, ");
+  Serial.print(load.headroom * 100.0f);
+  Serial.print("% headroom, ");
+  Serial.print(load.latency_us);
+  Serial.print(" us latency, ");
+  Serial.print(load.transfers_per_s);
+  Serial.print(" transfers/s, ");
+  Serial.println(load.fits ? "fits" : "does not fit");
+}
+
+void Report() {
+  Print("I2C 400 kHz, Read",
+        MpuTiming::Snapshot<bfs::Mpu9250>(MpuTiming::I2c(), NUM_IMU, SRD));
+  Print("I2C 400 kHz, FIFO",
+        MpuTiming::Fifo(MpuTiming::I2c(), NUM_IMU, SRD, DRAIN_HZ));
+  Print("SPI 15 MHz, Read",
+        MpuTiming::Snapshot<bfs::Mpu9250>(MpuTiming::Spi(), NUM_IMU, SRD));
+  Print("SPI 15 MHz, FIFO",
+        MpuTiming::Fifo(MpuTiming::Spi(), NUM_IMU, SRD, DRAIN_HZ));
+}
+
+int main() {
+  /* Serial to display the results */
+  Serial.begin(115200);
+  while(!Serial) {}
+  Report();
+  while(1) {}
+}
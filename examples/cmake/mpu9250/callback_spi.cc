@@ -0,0 +1,92 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu9250.h"
+
+/* Mpu9250 object, SPI bus, CS on pin 10 */
+bfs::Mpu9250 imu(&SPI, 10);
+
+/* Plain function callback, the context is unused here */
+void OnImu(const bfs::Mpu9250::Sample &sample, void *) {
+  Serial.print(sample.accel_x_mps2);
+  Serial.print("\t");
+  Serial.print(sample.accel_y_mps2);
+  Serial.print("\t");
+  Serial.print(sample.accel_z_mps2);
+  Serial.print("\t");
+  Serial.print(sample.gyro_x_radps);
+  Serial.print("\t");
+  Serial.print(sample.gyro_y_radps);
+  Serial.print("\t");
+  Serial.print(sample.gyro_z_radps);
+  Serial.print("\t");
+  Serial.print(sample.die_temp_c);
+  Serial.print("\n");
+}
+
+/* Member function callbacks, bound at compile time */
+class MagMonitor {
+ public:
+  void NewData(const bfs::Mpu9250::MagSample &sample) {
+    Serial.print("Mag\t");
+    Serial.print(sample.mag_x_ut);
+    Serial.print("\t");
+    Serial.print(sample.mag_y_ut);
+    Serial.print("\t");
+    Serial.print(sample.mag_z_ut);
+    Serial.print("\n");
+  }
+  void Overflow() {
+    overflows++;
+  }
+  uint32_t overflows = 0;
+};
+MagMonitor monitor;
+
+int main() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Set the sample rate divider */
+  if (!imu.ConfigSrd(19)) {
+    Serial.println("Error configured SRD");
+    while(1) {}
+  }
+  /* Register the callbacks */
+  imu.OnNewImuData(OnImu, nullptr);
+  imu.OnNewMagData<MagMonitor, &MagMonitor::NewData>(&monitor);
+  imu.OnMagOverflow<MagMonitor, &MagMonitor::Overflow>(&monitor);
+  while(1) {
+    /* Callbacks are called from Read */
+    imu.Read();
+  }
+}
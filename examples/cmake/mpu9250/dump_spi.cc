@@ -0,0 +1,87 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2021 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu9250.h"
+
+/* Mpu9250 object, SPI bus, CS on pin 10 */
+bfs::Mpu9250 imu(&SPI, 10);
+/* Snapshot after Begin, the latest snapshot, and the expected settings */
+bfs::Mpu9250::RegisterDump baseline, dump, expected;
+bfs::Mpu9250::RegisterDiff diffs[32];
+
+void PrintDiffs(const char *name, const size_t num_diffs) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(num_diffs);
+  Serial.println(" differences");
+  for (size_t i = 0; (i < num_diffs) && (i < 32); i++) {
+    Serial.print(diffs[i].mag ? "  AK8963 0x" : "  0x");
+    Serial.print(diffs[i].reg, HEX);
+    Serial.print(": 0x");
+    Serial.print(diffs[i].value, HEX);
+    Serial.print(", expected 0x");
+    Serial.println(diffs[i].expected, HEX);
+  }
+}
+
+void Diagnose() {
+  uint32_t t0 = micros();
+  if (!imu.DumpRegisters(&dump)) {
+    Serial.println("Error reading the registers");
+    return;
+  }
+  uint32_t t1 = micros();
+  Serial.print("Dump took ");
+  Serial.print(t1 - t0);
+  Serial.println(" us");
+  imu.ExpectedRegisters(&expected);
+  size_t num_diffs = bfs::Mpu9250::DiffRegisters(dump, expected, diffs, 32);
+  PrintDiffs("Expected", num_diffs);
+  num_diffs = bfs::Mpu9250::DiffRegisters(dump, baseline, diffs, 32);
+  PrintDiffs("Baseline", num_diffs);
+}
+
+int main() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Capture the baseline */
+  if (!imu.DumpRegisters(&baseline)) {
+    Serial.println("Error reading the registers");
+    while(1) {}
+  }
+  /* Change the configuration, the baseline diff shows the changes */
+  imu.ConfigAccelRange(bfs::Mpu9250::ACCEL_RANGE_4G);
+  imu.ConfigSrd(19);
+  Diagnose();
+  while(1) {}
+}
@@ -0,0 +1,72 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu9250.h"
+
+/* Mpu9250 object, SPI bus, CS on pin 10 */
+bfs::Mpu9250 imu(&SPI, 10);
+/* Shock event record */
+bfs::Mpu9250::ShockEvent event;
+
+int main() {
+  /* Serial to display data */
+  Serial.begin(115200);
+  while(!Serial) {}
+  /* Start the SPI bus */
+  SPI.begin();
+  /* Initialize and configure IMU */
+  if (!imu.Begin()) {
+    Serial.println("Error initializing communication with IMU");
+    while(1) {}
+  }
+  /* Capture events exceeding 500 mg */
+  if (!imu.EnableShockCapture(500)) {
+    Serial.println("Error enabling shock capture");
+    while(1) {}
+  }
+  while (1) {
+    /*
+    * Poll often, so the event is still in the 36 ms pre-event history, and
+    * capture the history and a 36 sample post-event window
+    */
+    if (imu.ReadShock(36, &event)) {
+      if (!event.in_history) {
+        Serial.print("Event may precede the history, polled up to ");
+        Serial.print(event.poll_latency_ms);
+        Serial.println(" ms late");
+      }
+      for (size_t i = 0; i < event.num_frames; i++) {
+        Serial.print(static_cast<int>(i) - event.trigger_frame);
+        Serial.print("\t");
+        Serial.print(event.accel_cnts[i][1] * event.accel_scale_mps2);
+        Serial.print("\t");
+        Serial.print(event.accel_cnts[i][0] * event.accel_scale_mps2);
+        Serial.print("\t");
+        Serial.print(-event.accel_cnts[i][2] * event.accel_scale_mps2);
+        Serial.print("\n");
+      }
+    }
+  }
+}
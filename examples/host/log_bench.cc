@@ -0,0 +1,117 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Logs synthetic raw MPU-9250 frames to a file as fast as they can be made,
+* first with one fwrite per frame and then with BlockSink, buffered and with
+* O_DIRECT. Reports the sustained MB/s and the worst time spent by the
+* acquisition thread handing off a frame. The file is given as the first
+* argument and removed afterwards.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "block_sink.h"
+#include "mpu_batch.h"
+#include "mpu_synth.h"
+
+/* Frames logged per run, 64 MiB, and the recording they are taken from */
+static constexpr size_t NUM_FRAMES = (64u << 20) / bfs::IMU_FRAME_SIZE;
+static constexpr size_t REPLAY_FRAMES = 4096;
+/* Per count scales for the +/-16g and +/-2000 deg/s ranges */
+static constexpr float ACCEL_SCALE = bfs::AccelScaleMps2(16.0f);
+static constexpr float GYRO_SCALE = bfs::GyroScaleRadps(2000.0f);
+
+std::vector<uint8_t> replay(REPLAY_FRAMES * bfs::IMU_FRAME_SIZE);
+
+double Seconds(const std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       t0).count();
+}
+
+void Record() {
+  bfs::ImuSynth synth;
+  synth.Config(nullptr, nullptr, 1000.0f);
+  synth.ConfigNoise({0.03f, 0.0017f, 0.6f, 0.0005f, 0.00005f, 0, 0, 25}, 3);
+  bfs::RecordImuFrames(&synth, REPLAY_FRAMES, ACCEL_SCALE, GYRO_SCALE,
+                       replay.data());
+}
+
+void PerFrame(const char *path) {
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {return;}
+  uint32_t max_ns = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < NUM_FRAMES; i++) {
+    const auto t = std::chrono::steady_clock::now();
+    fwrite(replay.data() + (i % REPLAY_FRAMES) * bfs::IMU_FRAME_SIZE,
+           bfs::IMU_FRAME_SIZE, 1, fp);
+    const uint32_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t).count();
+    if (ns > max_ns) {max_ns = ns;}
+  }
+  fclose(fp);
+  const double dt = Seconds(t0);
+  printf("%-19s %8.1f MB/s, worst enqueue %8u ns\n", "fwrite per frame:",
+         NUM_FRAMES * bfs::IMU_FRAME_SIZE / dt * 1e-6, max_ns);
+}
+
+void Sink(const char *path, const bool direct) {
+  bfs::BlockSink sink;
+  if (!sink.Open(path, 64 * bfs::BlockSink::BLOCK_ALIGN, 8, direct)) {
+    printf("BlockSink%s: not supported here\n", direct ? " O_DIRECT" : "");
+    return;
+  }
+  /*
+  * A real acquisition thread would drop a frame that doesn't fit; the
+  * benchmark retries it, to measure the sustained file rate.
+  */
+  size_t retries = 0;
+  for (size_t i = 0; i < NUM_FRAMES; i++) {
+    while (!sink.Write(replay.data() + (i % REPLAY_FRAMES) *
+                       bfs::IMU_FRAME_SIZE, bfs::IMU_FRAME_SIZE)) {
+      retries++;
+      std::this_thread::yield();
+    }
+  }
+  sink.Close();
+  const bfs::BlockSink::Stats s = sink.stats();
+  printf("%-19s %8.1f MB/s, worst enqueue %8u ns, mean %.1f ns, "
+         "worst block write %u us, %zu frames retried\n",
+         direct ? "BlockSink O_DIRECT:" : "BlockSink:", s.write_mbps, s.max_enqueue_ns,
+         s.mean_enqueue_ns, s.max_write_us, retries);
+}
+
+int main(int argc, char **argv) {
+  const char *path = (argc > 1) ? argv[1] : "imu_log.bin";
+  Record();
+  PerFrame(path);
+  Sink(path, false);
+  Sink(path, true);
+  remove(path);
+  return 0;
+}
@@ -0,0 +1,275 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Host ingestion pipeline for replayed MPU-9250 streams. Each lane runs four
+* stages on their own threads: ingest from the replay transport, unpack and
+* convert, calibrate, filter, and fuse, then sink. Batches of frames are
+* handed between stages by pointer through lock-free queues and returned to
+* ingest when sunk. Reports the throughput per core from 1 to 64 streams.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mpu_batch.h"
+#include "mpu_synth.h"
+#include "spsc_queue.h"
+
+/* Frames per batch and batches per lane, which all fit in each queue */
+static constexpr size_t BATCH_FRAMES = 64;
+static constexpr size_t POOL_SIZE = 32;
+/* Recording replayed by every stream, 4 s at 1 kHz */
+static constexpr size_t REPLAY_FRAMES = 4096;
+static constexpr float RATE_HZ = 1000.0f;
+static constexpr float DT_S = 1.0f / RATE_HZ;
+/* Samples per run, split across the streams */
+static constexpr size_t RUN_SAMPLES = 1u << 22;
+static constexpr size_t NUM_STAGES = 4;
+static constexpr size_t MAX_STREAMS = 64;
+/* Per count scales for the +/-16g and +/-2000 deg/s ranges */
+static constexpr float ACCEL_SCALE = bfs::AccelScaleMps2(16.0f);
+static constexpr float GYRO_SCALE = bfs::GyroScaleRadps(2000.0f);
+/* Gyro low pass filter and complementary filter gains */
+static constexpr float GYRO_ALPHA = 0.2f;
+static constexpr float FUSE_GAIN = 0.02f;
+
+struct Batch {
+  size_t stream;
+  size_t num_frames;
+  uint8_t raw[BATCH_FRAMES * bfs::IMU_FRAME_SIZE];
+  float ax[BATCH_FRAMES], ay[BATCH_FRAMES], az[BATCH_FRAMES];
+  float gx[BATCH_FRAMES], gy[BATCH_FRAMES], gz[BATCH_FRAMES];
+  float temp[BATCH_FRAMES];
+  float roll[BATCH_FRAMES], pitch[BATCH_FRAMES];
+};
+using Queue = bfs::SpscQueue<Batch *, POOL_SIZE>;
+
+struct Stream {
+  /* Replay position and samples left to ingest */
+  size_t pos;
+  size_t remaining;
+  /* Calibration, filter, and attitude state */
+  float accel_bias[3], accel_gain[3], gyro_bias[3];
+  float gyro[3];
+  float roll, pitch;
+};
+
+struct Lane {
+  std::vector<size_t> streams;
+  Batch pool[POOL_SIZE];
+  /* Queues between the stages, and back to ingest */
+  Queue unpack, fuse, sink, free;
+  size_t samples = 0;
+  double checksum = 0.0;
+};
+
+std::vector<uint8_t> replay(REPLAY_FRAMES * bfs::IMU_FRAME_SIZE);
+Stream streams[MAX_STREAMS];
+
+/* Spins, yielding the core, until the item is pushed */
+void PushWait(Queue * const q, Batch * const b) {
+  while (!q->Push(b)) {std::this_thread::yield();}
+}
+/* Spins until at least one item is popped */
+size_t PopWait(Queue * const q, Batch ** const b, const size_t max) {
+  size_t num;
+  while ((num = q->Pop(b, max)) == 0) {std::this_thread::yield();}
+  return num;
+}
+
+/* A nullptr marks the end of the run and is passed down the pipeline */
+void Ingest(Lane * const lane) {
+  size_t active = lane->streams.size();
+  while (active) {
+    active = 0;
+    for (const size_t s : lane->streams) {
+      Stream &st = streams[s];
+      if (!st.remaining) {continue;}
+      active++;
+      Batch *b;
+      PopWait(&lane->free, &b, 1);
+      b->stream = s;
+      b->num_frames = std::min(BATCH_FRAMES, st.remaining);
+      st.remaining -= b->num_frames;
+      size_t done = 0;
+      while (done < b->num_frames) {
+        const size_t n = std::min(b->num_frames - done,
+                                  REPLAY_FRAMES - st.pos);
+        memcpy(b->raw + done * bfs::IMU_FRAME_SIZE,
+               replay.data() + st.pos * bfs::IMU_FRAME_SIZE,
+               n * bfs::IMU_FRAME_SIZE);
+        done += n;
+        st.pos = (st.pos + n) % REPLAY_FRAMES;
+      }
+      PushWait(&lane->unpack, b);
+    }
+  }
+  PushWait(&lane->unpack, nullptr);
+}
+
+void Unpack(Lane * const lane) {
+  Batch *b[POOL_SIZE];
+  while (1) {
+    const size_t num = PopWait(&lane->unpack, b, POOL_SIZE);
+    for (size_t i = 0; i < num; i++) {
+      if (b[i]) {
+        bfs::ImuFrameArrays out = {b[i]->ax, b[i]->ay, b[i]->az, b[i]->gx,
+                                   b[i]->gy, b[i]->gz, b[i]->temp};
+        bfs::UnpackImuFrames(b[i]->raw, b[i]->num_frames, ACCEL_SCALE,
+                             GYRO_SCALE, &out);
+      }
+      PushWait(&lane->fuse, b[i]);
+      if (!b[i]) {return;}
+    }
+  }
+}
+
+void Fuse(Lane * const lane) {
+  Batch *b[POOL_SIZE];
+  while (1) {
+    const size_t num = PopWait(&lane->fuse, b, POOL_SIZE);
+    for (size_t i = 0; i < num; i++) {
+      if (b[i]) {
+        Batch &bt = *b[i];
+        Stream &st = streams[bt.stream];
+        for (size_t k = 0; k < bt.num_frames; k++) {
+          /* Calibrate */
+          const float ax = (bt.ax[k] - st.accel_bias[0]) * st.accel_gain[0];
+          const float ay = (bt.ay[k] - st.accel_bias[1]) * st.accel_gain[1];
+          const float az = (bt.az[k] - st.accel_bias[2]) * st.accel_gain[2];
+          /* Low pass filter the gyro */
+          st.gyro[0] += GYRO_ALPHA * (bt.gx[k] - st.gyro_bias[0] - st.gyro[0]);
+          st.gyro[1] += GYRO_ALPHA * (bt.gy[k] - st.gyro_bias[1] - st.gyro[1]);
+          st.gyro[2] += GYRO_ALPHA * (bt.gz[k] - st.gyro_bias[2] - st.gyro[2]);
+          /* Complementary filter for roll and pitch */
+          const float roll_acc = atan2f(-ay, -az);
+          const float pitch_acc = atan2f(ax, sqrtf(ay * ay + az * az));
+          st.roll += st.gyro[0] * DT_S;
+          st.pitch += st.gyro[1] * DT_S;
+          st.roll += FUSE_GAIN * (roll_acc - st.roll);
+          st.pitch += FUSE_GAIN * (pitch_acc - st.pitch);
+          bt.roll[k] = st.roll;
+          bt.pitch[k] = st.pitch;
+        }
+      }
+      PushWait(&lane->sink, b[i]);
+      if (!b[i]) {return;}
+    }
+  }
+}
+
+void Sink(Lane * const lane) {
+  Batch *b[POOL_SIZE];
+  while (1) {
+    const size_t num = PopWait(&lane->sink, b, POOL_SIZE);
+    for (size_t i = 0; i < num; i++) {
+      if (!b[i]) {return;}
+      for (size_t k = 0; k < b[i]->num_frames; k++) {
+        lane->checksum += b[i]->roll[k] + b[i]->pitch[k];
+      }
+      lane->samples += b[i]->num_frames;
+      PushWait(&lane->free, b[i]);
+    }
+  }
+}
+
+/* Records the replay with a slow tumble */
+void Tumble(const double t_s, bfs::TrajectoryPoint * const point,
+            void *) {
+  const float t = static_cast<float>(t_s);
+  *point = {{0.3f * sinf(t), 0.2f * cosf(0.7f * t), 0.1f}, {0, 0, 0}, 30};
+}
+
+void Record() {
+  bfs::ImuSynth synth;
+  synth.Config(Tumble, nullptr, RATE_HZ);
+  synth.ConfigNoise({0.03f, 0.0017f, 0.6f, 0.0005f, 0.00005f, 0, 0, 25}, 7);
+  bfs::RecordImuFrames(&synth, REPLAY_FRAMES, ACCEL_SCALE, GYRO_SCALE,
+                       replay.data());
+}
+
+void Run(const size_t num_streams, const size_t num_cores) {
+  /* One lane per four cores, with the streams spread across the lanes */
+  const size_t num_lanes = std::min(num_streams,
+                                    std::max<size_t>(1, num_cores /
+                                                        NUM_STAGES));
+  std::vector<std::unique_ptr<Lane>> lanes;
+  for (size_t l = 0; l < num_lanes; l++) {
+    lanes.emplace_back(new Lane);
+    for (size_t i = 0; i < POOL_SIZE; i++) {
+      lanes[l]->free.Push(&lanes[l]->pool[i]);
+    }
+  }
+  for (size_t s = 0; s < num_streams; s++) {
+    Stream &st = streams[s];
+    st = {};
+    st.pos = (s * 97) % REPLAY_FRAMES;
+    st.remaining = RUN_SAMPLES / num_streams;
+    for (size_t i = 0; i < 3; i++) {
+      st.accel_bias[i] = 0.01f * static_cast<float>(s % 5);
+      st.accel_gain[i] = 1.0f + 0.001f * static_cast<float>(i);
+      st.gyro_bias[i] = 0.0001f * static_cast<float>(s % 3);
+    }
+    lanes[s % num_lanes]->streams.push_back(s);
+  }
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (auto &lane : lanes) {
+    threads.emplace_back(Ingest, lane.get());
+    threads.emplace_back(Unpack, lane.get());
+    threads.emplace_back(Fuse, lane.get());
+    threads.emplace_back(Sink, lane.get());
+  }
+  for (auto &t : threads) {t.join();}
+  const auto t1 = std::chrono::steady_clock::now();
+  const double dt = std::chrono::duration<double>(t1 - t0).count();
+  size_t samples = 0;
+  double checksum = 0.0;
+  for (auto &lane : lanes) {
+    samples += lane->samples;
+    checksum += lane->checksum;
+  }
+  const size_t cores = std::min(num_cores, threads.size());
+  printf("%3zu streams %3zu threads %8.2f Msamples/s %8.2f Msamples/s/core"
+         "  (%zu samples, check %.1f)\n", num_streams, threads.size(),
+         samples / dt * 1e-6, samples / dt * 1e-6 / cores, samples,
+         checksum / samples);
+}
+
+int main() {
+  const size_t num_cores = std::max(1u, std::thread::hardware_concurrency());
+  printf("%zu cores, %zu frames per batch\n", num_cores, BATCH_FRAMES);
+  Record();
+  for (size_t n = 1; n <= MAX_STREAMS; n *= 2) {
+    Run(n, num_cores);
+  }
+  return 0;
+}
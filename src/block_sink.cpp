@@ -0,0 +1,234 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "block_sink.h"  // NOLINT
+#if !defined(ARDUINO)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace bfs {
+
+namespace {
+/* Writer poll period when no block is full */
+constexpr auto WRITER_IDLE = std::chrono::microseconds(100);
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+BlockSink::~BlockSink() {
+  if (is_open()) {Close();}
+}
+
+bool BlockSink::Open(const char *path, const size_t block_size,
+                     const size_t num_blocks, const bool direct) {
+  if ((is_open()) || (!path)) {return false;}
+  if ((block_size == 0) || (block_size % BLOCK_ALIGN)) {return false;}
+  if ((num_blocks < 2) || (num_blocks > MAX_BLOCKS)) {return false;}
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (direct) {
+    #if defined(O_DIRECT)
+    flags |= O_DIRECT;
+    #else
+    return false;
+    #endif
+  }
+  void *mem;
+  if (posix_memalign(&mem, BLOCK_ALIGN, block_size * num_blocks)) {
+    return false;
+  }
+  /* Touch every page now, so Write never takes a page fault */
+  memset(mem, 0, block_size * num_blocks);
+  fd_ = open(path, flags, 0644);
+  if (fd_ < 0) {
+    free(mem);
+    return false;
+  }
+  mem_ = static_cast<uint8_t *>(mem);
+  direct_ = direct;
+  block_size_ = block_size;
+  num_blocks_ = num_blocks;
+  cur_ = mem_;
+  fill_ = 0;
+  uint8_t *blocks[MAX_BLOCKS];
+  while (full_.Pop(blocks, MAX_BLOCKS)) {}
+  while (free_.Pop(blocks, MAX_BLOCKS)) {}
+  for (size_t i = 1; i < num_blocks_; i++) {
+    free_.Push(mem_ + i * block_size_);
+  }
+  done_ = false;
+  error_ = false;
+  bytes_written_ = 0;
+  blocks_written_ = 0;
+  max_write_us_ = 0;
+  bytes_dropped_ = 0;
+  num_enqueue_ = 0;
+  sum_enqueue_ns_ = 0;
+  max_enqueue_ns_ = 0;
+  open_ns_ = NowNs();
+  last_write_ns_ = open_ns_;
+  writer_ = std::thread(&BlockSink::Writer, this);
+  return true;
+}
+
+bool BlockSink::Write(const void * const data, const size_t len) {
+  if ((!is_open()) || (!data)) {return false;}
+  const int64_t t0 = NowNs();
+  /*
+  * Drop the whole write unless it fits, so frames are never split by a
+  * drop. The free count only grows while the writer runs.
+  */
+  size_t room = (cur_ ? block_size_ - fill_ : 0) + free_.size() * block_size_;
+  bool status = (len <= room) && (!error_.load(std::memory_order_relaxed));
+  if (status) {
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    size_t left = len;
+    while (left) {
+      if (!cur_) {
+        free_.Pop(&cur_);
+        fill_ = 0;
+      }
+      const size_t n = (left < block_size_ - fill_) ? left :
+                       block_size_ - fill_;
+      memcpy(cur_ + fill_, src, n);
+      fill_ += n;
+      src += n;
+      left -= n;
+      if (fill_ == block_size_) {
+        full_.Push(cur_);
+        cur_ = nullptr;
+      }
+    }
+  } else {
+    bytes_dropped_ += len;
+  }
+  const uint32_t dt = static_cast<uint32_t>(NowNs() - t0);
+  num_enqueue_++;
+  sum_enqueue_ns_ += dt;
+  if (dt > max_enqueue_ns_) {max_enqueue_ns_ = dt;}
+  return status;
+}
+
+bool BlockSink::Close() {
+  if (!is_open()) {return false;}
+  done_.store(true, std::memory_order_release);
+  writer_.join();
+  /* Write the partial block, padded to the alignment with O_DIRECT */
+  bool status = !error_;
+  if ((status) && (cur_) && (fill_)) {
+    const size_t len = direct_ ?
+      (fill_ + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN : fill_;
+    memset(cur_ + fill_, 0, len - fill_);
+    size_t done = 0;
+    while (done < len) {
+      const ssize_t ret = write(fd_, cur_ + done, len - done);
+      if (ret < 0) {
+        if (errno == EINTR) {continue;}
+        status = false;
+        break;
+      }
+      done += static_cast<size_t>(ret);
+    }
+    if (status) {
+      bytes_written_ += fill_;
+      if ((len != fill_) &&
+          (ftruncate(fd_, static_cast<off_t>(bytes_written_)) != 0)) {
+        status = false;
+      }
+    }
+  }
+  if (close(fd_) != 0) {status = false;}
+  fd_ = -1;
+  free(mem_);
+  mem_ = nullptr;
+  cur_ = nullptr;
+  fill_ = 0;
+  return status;
+}
+
+BlockSink::Stats BlockSink::stats() const {
+  Stats s;
+  s.bytes_written = bytes_written_;
+  s.bytes_dropped = bytes_dropped_;
+  s.blocks_written = blocks_written_;
+  const int64_t dt_ns = last_write_ns_ - open_ns_;
+  s.write_mbps = (dt_ns > 0) ?
+    static_cast<double>(s.bytes_written) / static_cast<double>(dt_ns) * 1e3 :
+    0.0;
+  s.max_enqueue_ns = max_enqueue_ns_;
+  s.mean_enqueue_ns = num_enqueue_ ?
+    static_cast<double>(sum_enqueue_ns_) / static_cast<double>(num_enqueue_) :
+    0.0;
+  s.max_write_us = max_write_us_;
+  return s;
+}
+
+void BlockSink::Writer() {
+  uint8_t *block;
+  while (1) {
+    /* Check for the end first, so the blocks queued before it are drained */
+    const bool done = done_.load(std::memory_order_acquire);
+    if (full_.Pop(&block)) {
+      if (!WriteBlock(block)) {error_ = true;}
+      free_.Push(block);
+    } else if (done) {
+      return;
+    } else {
+      std::this_thread::sleep_for(WRITER_IDLE);
+    }
+  }
+}
+
+bool BlockSink::WriteBlock(const uint8_t * const block) {
+  /* Keep failing once a write fails, the file is no longer contiguous */
+  if (error_) {return false;}
+  const int64_t t0 = NowNs();
+  size_t done = 0;
+  while (done < block_size_) {
+    const ssize_t ret = write(fd_, block + done, block_size_ - done);
+    if (ret < 0) {
+      if (errno == EINTR) {continue;}
+      return false;
+    }
+    done += static_cast<size_t>(ret);
+  }
+  const int64_t t1 = NowNs();
+  const uint32_t us = static_cast<uint32_t>((t1 - t0) / 1000);
+  if (us > max_write_us_) {max_write_us_ = us;}
+  bytes_written_ += block_size_;
+  blocks_written_++;
+  last_write_ns_ = t1;
+  return true;
+}
+
+}  // namespace bfs
+
+#endif  // ARDUINO
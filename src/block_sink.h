@@ -0,0 +1,112 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_BLOCK_SINK_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_BLOCK_SINK_H_
+
+/* Host only, uses POSIX files and a writer thread */
+#if !defined(ARDUINO)
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "spsc_queue.h"
+
+namespace bfs {
+
+/*
+* Logging sink for raw frames on a host. Data is copied into block aligned
+* buffers and full blocks are handed to a writer thread, so Write never
+* waits on the file; if the writer falls behind and no buffer is free, the
+* data is dropped and counted instead.
+*/
+class BlockSink {
+ public:
+  /* Blocks are a multiple of the 4 KiB page and sector size */
+  static constexpr size_t BLOCK_ALIGN = 4096;
+  static constexpr size_t MAX_BLOCKS = 64;
+  struct Stats {
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;
+    uint64_t blocks_written;
+    /* Sustained write rate from Open to the last block written */
+    double write_mbps;
+    /* Time spent in Write, worst and mean */
+    uint32_t max_enqueue_ns;
+    double mean_enqueue_ns;
+    /* Longest single block write */
+    uint32_t max_write_us;
+  };
+  ~BlockSink();
+  /*
+  * Opens the file with num_blocks buffers of block_size bytes; two is
+  * double buffering. O_DIRECT bypasses the page cache and fails on file
+  * systems that don't support it.
+  */
+  bool Open(const char *path, const size_t block_size = 64 * BLOCK_ALIGN,
+            const size_t num_blocks = 4, const bool direct = false);
+  /* Never blocks, returns false if the data was dropped */
+  bool Write(const void * const data, const size_t len);
+  /* Writes the partial block, waits for the writer, and closes the file */
+  bool Close();
+  Stats stats() const;
+  inline bool is_open() const {return fd_ >= 0;}
+
+ private:
+  int fd_ = -1;
+  bool direct_ = false;
+  size_t block_size_ = 0;
+  size_t num_blocks_ = 0;
+  uint8_t *mem_ = nullptr;
+  /* Block being filled and the bytes in it */
+  uint8_t *cur_ = nullptr;
+  size_t fill_ = 0;
+  /* Full blocks to the writer, written blocks back */
+  SpscQueue<uint8_t *, MAX_BLOCKS> full_;
+  SpscQueue<uint8_t *, MAX_BLOCKS> free_;
+  std::thread writer_;
+  std::atomic<bool> done_{false};
+  std::atomic<bool> error_{false};
+  /* Written by the writer thread */
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> blocks_written_{0};
+  std::atomic<uint32_t> max_write_us_{0};
+  std::atomic<int64_t> last_write_ns_{0};
+  /* Written by the acquisition thread */
+  uint64_t bytes_dropped_ = 0;
+  uint64_t num_enqueue_ = 0;
+  uint64_t sum_enqueue_ns_ = 0;
+  uint32_t max_enqueue_ns_ = 0;
+  int64_t open_ns_ = 0;
+  void Writer();
+  bool WriteBlock(const uint8_t * const block);
+};
+
+}  // namespace bfs
+
+#endif  // ARDUINO
+
+#endif  // INVENSENSE_IMU_SRC_BLOCK_SINK_H_ NOLINT
@@ -0,0 +1,168 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "fault_injector.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "core/core.h"
+#endif
+
+namespace bfs {
+
+void FaultInjector::Config(const Rates &rates) {
+  rates_ = rates;
+  stuck_left_ = 0;
+}
+
+void FaultInjector::Seed(const uint32_t seed) {
+  /* Xorshift has a fixed point at zero */
+  state_ = seed ? seed : 1;
+}
+
+void FaultInjector::ClearCounts() {
+  counts_ = {};
+}
+
+/* Called from the bus transfers, see INVENSENSE_IMU_NO_SLEEP */
+INVENSENSE_IMU_NO_SLEEP
+
+uint32_t FaultInjector::Rand() {
+  state_ ^= state_ << 13;
+  state_ ^= state_ >> 17;
+  state_ ^= state_ << 5;
+  return state_;
+}
+
+FaultInjector::Fault FaultInjector::Draw(const bool read,
+                                        const uint8_t reg) {
+  const Fault fault = Next(read);
+  if (fault == FAULT_RESET) {reset_ = true;}
+  /* Writing the clock source, the first step of Begin, wakes the sensor */
+  if ((!read) && (reg == PWR_MGMNT_1_) && (fault != FAULT_NACK)) {
+    reset_ = false;
+  }
+  return fault;
+}
+
+FaultInjector::Fault FaultInjector::Next(const bool read) {
+  counts_.transfers++;
+  uint32_t r = Rand() % PPM_;
+  if (r < rates_.nack_ppm) {
+    counts_.nack++;
+    return FAULT_NACK;
+  }
+  r -= rates_.nack_ppm;
+  if (r < rates_.reset_ppm) {
+    counts_.reset++;
+    return FAULT_RESET;
+  }
+  r -= rates_.reset_ppm;
+  /* The remaining faults corrupt read data */
+  if (!read) {return FAULT_NONE;}
+  if (r < rates_.short_read_ppm) {
+    counts_.short_read++;
+    return FAULT_SHORT_READ;
+  }
+  r -= rates_.short_read_ppm;
+  if (r < rates_.bit_flip_ppm) {
+    counts_.bit_flip++;
+    return FAULT_BIT_FLIP;
+  }
+  r -= rates_.bit_flip_ppm;
+  if (r < rates_.stuck_ppm) {
+    counts_.stuck++;
+    return FAULT_STUCK;
+  }
+  return FAULT_NONE;
+}
+
+bool FaultInjector::Apply(const Fault fault, const uint8_t reg,
+                          const uint8_t count, const bool i2c,
+                          uint8_t * const data) {
+  if ((!data) || (count == 0)) {return false;}
+  const bool status = ApplyFault(fault, reg, count, i2c, data);
+  if (reset_) {ClearData(reg, count, data);}
+  return status;
+}
+
+bool FaultInjector::ApplyFault(const Fault fault, const uint8_t reg,
+                               const uint8_t count, const bool i2c,
+                               uint8_t * const data) {
+  switch (fault) {
+    case FAULT_NACK: {
+      if (i2c) {return false;}
+      memset(data, 0xFF, count);
+      return true;
+    }
+    case FAULT_SHORT_READ: {
+      if (i2c) {return false;}
+      const uint8_t valid = Rand() % count;
+      memset(data + valid, 0xFF, count - valid);
+      return true;
+    }
+    case FAULT_BIT_FLIP: {
+      data[Rand() % count] ^= static_cast<uint8_t>(1u << (Rand() % 8));
+      return true;
+    }
+    case FAULT_STUCK: {
+      if ((count <= MAX_STUCK_BYTES_) && (rates_.stuck_reads > 0)) {
+        stuck_left_ = rates_.stuck_reads;
+        stuck_reg_ = reg;
+        stuck_count_ = count;
+        memcpy(stuck_data_, data, count);
+      }
+      return true;
+    }
+    default: {
+      if ((stuck_left_ > 0) && (reg == stuck_reg_) &&
+          (count == stuck_count_)) {
+        memcpy(data, stuck_data_, count);
+        stuck_left_--;
+      }
+      return true;
+    }
+  }
+}
+
+void FaultInjector::ClearData(const uint8_t reg, const uint8_t count,
+                              uint8_t * const data) const {
+  /* A reset sensor is not sampling and its FIFO is empty */
+  if (reg == FIFO_READ_) {
+    memset(data, 0, count);
+    return;
+  }
+  for (uint16_t r = reg; r < reg + count; r++) {
+    if (((r >= INT_STATUS_) && (r <= GYRO_ZOUT_L_)) || (r == FIFO_COUNT_) ||
+        (r == FIFO_COUNT_ + 1)) {
+      data[r - reg] = 0;
+    }
+  }
+}
+
+}  // namespace bfs
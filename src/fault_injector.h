@@ -0,0 +1,132 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_FAULT_INJECTOR_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_FAULT_INJECTOR_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+#include "invensense_imu.h"  // NOLINT
+
+namespace bfs {
+
+/*
+* Injects bus faults into the transfers of an InvensenseImu, for testing how
+* an application detects and recovers from them. Attached with ConfigFaults,
+* which requires INVENSENSE_IMU_FAULT_INJECTION. Each transfer draws at most
+* one new fault, using a seeded pseudo-random sequence so runs repeat.
+*/
+class FaultInjector {
+ public:
+  enum Fault : int8_t {
+    FAULT_NONE,
+    /* I2C transfer fails; on SPI writes are dropped and reads return 0xFF */
+    FAULT_NACK,
+    /* Read ends early; I2C reports it, on SPI the tail bytes read 0xFF */
+    FAULT_SHORT_READ,
+    /* One random bit of the read data is inverted */
+    FAULT_BIT_FLIP,
+    /* The read data repeats for the next stuck_reads of the same registers */
+    FAULT_STUCK,
+    /*
+    * The sensor reads as reset, with no data ready and an empty FIFO, until
+    * PWR_MGMT_1 is written again, e.g. by Begin. Nothing is written to it.
+    */
+    FAULT_RESET
+  };
+  /* Probability of each fault per transfer, in parts per million */
+  struct Rates {
+    uint32_t nack_ppm;
+    uint32_t short_read_ppm;
+    uint32_t bit_flip_ppm;
+    uint32_t stuck_ppm;
+    uint32_t reset_ppm;
+    uint16_t stuck_reads;
+  };
+  /* Number of transfers and of each injected fault */
+  struct Counts {
+    uint32_t transfers;
+    uint32_t nack;
+    uint32_t short_read;
+    uint32_t bit_flip;
+    uint32_t stuck;
+    uint32_t reset;
+  };
+  FaultInjector() {}
+  explicit FaultInjector(const Rates &rates, const uint32_t seed = 1) :
+                         rates_(rates), state_(seed ? seed : 1) {}
+  void Config(const Rates &rates);
+  void Seed(const uint32_t seed);
+  void ClearCounts();
+  inline const Counts &counts() const {return counts_;}
+  /* Whether the sensor reads as reset, see FAULT_RESET */
+  inline bool reset() const {return reset_;}
+  /* Used by InvensenseImu: draws the fault for the next transfer */
+  INVENSENSE_IMU_ISR_SAFE
+  Fault Draw(const bool read, const uint8_t reg);
+  /*
+  * Used by InvensenseImu: applies the fault drawn for a read to the received
+  * data and returns whether the read still reports success.
+  */
+  INVENSENSE_IMU_ISR_SAFE
+  bool Apply(const Fault fault, const uint8_t reg, const uint8_t count,
+             const bool i2c, uint8_t * const data);
+
+ private:
+  INVENSENSE_IMU_ISR_SAFE uint32_t Rand();
+  INVENSENSE_IMU_ISR_SAFE Fault Next(const bool read);
+  INVENSENSE_IMU_ISR_SAFE
+  bool ApplyFault(const Fault fault, const uint8_t reg, const uint8_t count,
+                  const bool i2c, uint8_t * const data);
+  INVENSENSE_IMU_ISR_SAFE
+  void ClearData(const uint8_t reg, const uint8_t count,
+                 uint8_t * const data) const;
+  Rates rates_ = {};
+  Counts counts_ = {};
+  uint32_t state_ = 1;
+  /* Stuck value, reads longer than MAX_STUCK_BYTES_ do not get stuck */
+  static constexpr uint8_t MAX_STUCK_BYTES_ = 32;
+  static constexpr uint32_t PPM_ = 1000000;
+  /* Registers that read as zero while reset */
+  static constexpr uint8_t INT_STATUS_ = 0x3A;
+  static constexpr uint8_t GYRO_ZOUT_L_ = 0x48;
+  static constexpr uint8_t PWR_MGMNT_1_ = 0x6B;
+  static constexpr uint8_t FIFO_COUNT_ = 0x72;
+  static constexpr uint8_t FIFO_READ_ = 0x74;
+  bool reset_ = false;
+  uint16_t stuck_left_ = 0;
+  uint8_t stuck_reg_;
+  uint8_t stuck_count_;
+  uint8_t stuck_data_[MAX_STUCK_BYTES_];
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_FAULT_INJECTOR_H_ NOLINT
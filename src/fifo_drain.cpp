@@ -0,0 +1,150 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "fifo_drain.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include "core/core.h"
+#endif
+
+namespace bfs {
+
+bool FifoDrain::Config(const Settings &settings) {
+  if ((settings.sample_rate_hz <= 0.0f) || (settings.latency_us <= 0.0f) ||
+      (settings.budget <= 0.0f) || (settings.budget > 1.0f)) {
+    return false;
+  }
+  settings_ = settings;
+  /*
+  * The batch Read reads the frames in bursts. Per drain: the count, the CPU
+  * time, and at most one partial burst; per frame, its bytes and a share of
+  * the transfer overhead of a full burst.
+  */
+  const float burst = MpuTiming::BurstFrames(settings.bus);
+  drain_us_ = MpuTiming::ReadUs(settings.bus, MpuTiming::FIFO_COUNT_SIZE) +
+              settings.cpu_us + MpuTiming::ReadUs(settings.bus, 0);
+  frame_us_ = MpuTiming::FramesUs(settings.bus, burst) / burst;
+  point_ = {};
+  point_.rate_hz = settings.sample_rate_hz;
+  started_ = false;
+  window_us_ = 0;
+  window_frames_ = 0;
+  Choose();
+  return true;
+}
+
+bool FifoDrain::Due(const uint32_t now_us) const {
+  if (!started_) {return true;}
+  return (now_us - last_us_) >= point_.interval_us;
+}
+
+uint32_t FifoDrain::Update(const uint32_t now_us, const size_t num_frames) {
+  if (started_) {
+    const uint32_t dt_us = now_us - last_us_;
+    const float frames = static_cast<float>(num_frames);
+    if (num_frames >= FIFO_FRAMES) {
+      /*
+      * A full FIFO has likely overflowed. Raise the jitter estimate so the
+      * overflow margin halves the batch, it recovers as the jitter decays.
+      */
+      point_.overflows++;
+      const float jitter = (FIFO_FRAMES - 0.5f * point_.batch_frames) /
+                           JITTER_MARGIN_;
+      if (jitter > point_.jitter_frames) {point_.jitter_frames = jitter;}
+      /* Samples were lost, so this window can't measure the rate */
+      window_us_ = 0;
+      window_frames_ = 0;
+    } else {
+      /* Frames expected at the measured rate, and the deviation from it */
+      const float expected = point_.rate_hz * static_cast<float>(dt_us) *
+                             1e-6f;
+      point_.jitter_frames += JITTER_GAIN_ * (fabsf(frames - expected) -
+                                              point_.jitter_frames);
+      window_us_ += dt_us;
+      window_frames_ += num_frames;
+      if (window_us_ >= RATE_WINDOW_US_) {
+        const float rate = static_cast<float>(window_frames_) * 1e6f /
+                           static_cast<float>(window_us_);
+        /* Ignore windows far from the configured rate, i.e. a stall */
+        if (fabsf(rate - settings_.sample_rate_hz) <
+            RATE_TOL_ * settings_.sample_rate_hz) {
+          point_.rate_hz += RATE_GAIN_ * (rate - point_.rate_hz);
+        }
+        window_us_ = 0;
+        window_frames_ = 0;
+      }
+    }
+  }
+  last_us_ = now_us;
+  started_ = true;
+  Choose();
+  return point_.interval_us;
+}
+
+void FifoDrain::Choose() {
+  const float period_us = 1e6f / point_.rate_hz;
+  /* Largest batch keeping a margin from overflow */
+  int32_t max_batch = FIFO_FRAMES - 1 -
+    static_cast<int32_t>(ceilf(JITTER_MARGIN_ * point_.jitter_frames));
+  if (max_batch < 1) {max_batch = 1;}
+  /* Largest batch meeting the latency target */
+  int32_t batch = static_cast<int32_t>(
+    floorf((settings_.latency_us - drain_us_) / (period_us + frame_us_)));
+  if (batch > max_batch) {batch = max_batch;}
+  if (batch < 1) {batch = 1;}
+  /* Grow the batch if needed to stay within the bus budget */
+  if (Occupancy(static_cast<float>(batch)) > settings_.budget) {
+    const float free = settings_.budget - frame_us_ * 1e-6f * point_.rate_hz;
+    if (free <= 0.0f) {
+      batch = max_batch;
+    } else {
+      const int32_t min_batch = static_cast<int32_t>(
+        ceilf(drain_us_ * 1e-6f * point_.rate_hz / free));
+      batch = (min_batch > max_batch) ? max_batch : min_batch;
+    }
+  }
+  point_.batch_frames = static_cast<uint8_t>(batch);
+  point_.interval_us = static_cast<uint32_t>(
+    lroundf(static_cast<float>(batch) * period_us));
+  point_.latency_us = Latency(static_cast<float>(batch));
+  point_.occupancy = Occupancy(static_cast<float>(batch));
+  point_.meets_latency = (point_.latency_us <= settings_.latency_us);
+  point_.meets_budget = (point_.occupancy <= settings_.budget);
+}
+
+float FifoDrain::Occupancy(const float batch) const {
+  return point_.rate_hz * 1e-6f * (drain_us_ / batch + frame_us_);
+}
+
+float FifoDrain::Latency(const float batch) const {
+  /* The oldest sample waits a batch of periods, then for the drain */
+  return batch * (1e6f / point_.rate_hz + frame_us_) + drain_us_;
+}
+
+}  // namespace bfs
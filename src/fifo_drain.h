@@ -0,0 +1,116 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_FIFO_DRAIN_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_FIFO_DRAIN_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+#include "mpu_timing.h"  // NOLINT
+
+namespace bfs {
+
+/*
+* Timer driven FIFO drain scheduler. The MPU has no FIFO watermark
+* interrupt, so the FIFO is drained on a timer, and the interval sets the
+* batch size: larger batches spend less bus and CPU time per sample but add
+* latency and come closer to overflowing. FifoDrain picks the largest batch
+* that meets the latency target, grows it if needed to stay within the bus
+* budget, and keeps a margin from overflow. It tracks the sample rate and
+* jitter seen in the frames read by each drain, since the sensor and timer
+* clocks differ, and backs off after an overflow.
+*/
+class FifoDrain {
+ public:
+  /* The 512 byte FIFO holds 36 frames */
+  static constexpr uint8_t FIFO_FRAMES = MpuTiming::FIFO_FRAMES;
+  struct Settings {
+    float sample_rate_hz;
+    /* Target for the age of the oldest sample when it has been read */
+    float latency_us;
+    /* Fraction of the bus and CPU time allowed for draining */
+    float budget;
+    MpuTiming::Bus bus;
+    /* CPU time per drain besides the transfers, i.e. the timer interrupt */
+    float cpu_us;
+  };
+  struct OperatingPoint {
+    uint8_t batch_frames;
+    uint32_t interval_us;
+    /* Worst case age of a sample when read, and fraction of time draining */
+    float latency_us;
+    float occupancy;
+    /* Sample rate and jitter, in frames per drain, measured */
+    float rate_hz;
+    float jitter_frames;
+    bool meets_latency;
+    bool meets_budget;
+    uint32_t overflows;
+  };
+  bool Config(const Settings &settings);
+  /* Returns true when the next drain is due */
+  bool Due(const uint32_t now_us) const;
+  /*
+  * Call after each drain with the time and the number of frames read,
+  * i.e. the return of the batch Read; returns the next interval. The Read
+  * must allow at least FIFO_FRAMES samples, since an overflow is detected
+  * from a full FIFO and a smaller read never sees one.
+  */
+  uint32_t Update(const uint32_t now_us, const size_t num_frames);
+  inline uint32_t interval_us() const {return point_.interval_us;}
+  inline const OperatingPoint &point() const {return point_;}
+
+ private:
+  /*
+  * The sample rate is measured over windows of about a second, so the one
+  * frame uncertainty of each drain averages out, and filtered
+  */
+  static constexpr uint32_t RATE_WINDOW_US_ = 1000000;
+  static constexpr float RATE_GAIN_ = 0.25f;
+  static constexpr float RATE_TOL_ = 0.1f;
+  static constexpr float JITTER_GAIN_ = 1.0f / 8.0f;
+  /* Jitter multiple kept free in the FIFO */
+  static constexpr float JITTER_MARGIN_ = 4.0f;
+  Settings settings_;
+  OperatingPoint point_;
+  float drain_us_;
+  float frame_us_;
+  uint32_t last_us_;
+  bool started_ = false;
+  uint32_t window_us_;
+  uint32_t window_frames_;
+  void Choose();
+  float Occupancy(const float batch) const;
+  float Latency(const float batch) const;
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_FIFO_DRAIN_H_ NOLINT
@@ -0,0 +1,301 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "flight_recorder.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+
+namespace bfs {
+
+namespace {
+/* Header field offsets */
+constexpr size_t LEN_POS = 0;
+constexpr size_t SEQ_POS = 2;
+constexpr size_t NUM_POS = 6;
+constexpr size_t FIRST_POS = 7;
+constexpr size_t WIDTH_POS = FIRST_POS + 2 * FlightRecorder::NUM_CH;
+constexpr uint8_t MAX_WIDTH = 17;
+
+void Put16(const uint16_t val, uint8_t * const p) {
+  p[0] = static_cast<uint8_t>(val);
+  p[1] = static_cast<uint8_t>(val >> 8);
+}
+uint16_t Get16(const uint8_t * const p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+/* Maps small negative and positive deltas to small unsigned values */
+uint32_t ZigZag(const int32_t val) {
+  return (static_cast<uint32_t>(val) << 1) ^ static_cast<uint32_t>(val >> 31);
+}
+uint8_t Width(uint32_t val) {
+  uint8_t w = 0;
+  while (val) {
+    w++;
+    val >>= 1;
+  }
+  return w;
+}
+/* Encoded block length for num samples at the given widths */
+size_t BlockLen(const uint8_t * const width, const size_t num) {
+  size_t bits = 0;
+  for (size_t ch = 0; ch < FlightRecorder::NUM_CH; ch++) {
+    bits += width[ch];
+  }
+  return FlightRecorder::HEADER_SIZE + (bits * (num - 1) + 7) / 8;
+}
+}  // namespace
+
+bool FlightRecorder::Config(uint8_t * const buf, const size_t size) {
+  if ((!buf) || (size < 2 * MAX_BLOCK_SIZE)) {return false;}
+  buf_ = buf;
+  size_ = size;
+  Clear();
+  return true;
+}
+
+void FlightRecorder::Clear() {
+  head_ = 0;
+  tail_ = 0;
+  end_ = size_;
+  count_ = 0;
+  used_ = 0;
+  seq_ = 0;
+  fill_ = 0;
+  pending_ = false;
+  frozen_ = false;
+}
+
+bool FlightRecorder::AddFrame(const uint8_t * const frame) {
+  if (!frame) {return false;}
+  int16_t cnts[NUM_CH];
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    cnts[ch] = static_cast<int16_t>(frame[2 * ch]) << 8 | frame[2 * ch + 1];
+  }
+  return Add(cnts);
+}
+
+bool FlightRecorder::Add(const int16_t cnts[NUM_CH]) {
+  if ((!buf_) || (frozen_)) {return false;}
+  /* Encode one sample of the previous block */
+  if (pending_) {EncodeSample();}
+  int16_t * const s = stage_[cur_][fill_];
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    s[ch] = cnts[ch];
+  }
+  if (fill_ == 0) {
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      zz_or_[ch] = 0;
+    }
+  } else {
+    const int16_t * const prev = stage_[cur_][fill_ - 1];
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      zz_or_[ch] |= ZigZag(static_cast<int32_t>(s[ch]) - prev[ch]);
+    }
+  }
+  fill_++;
+  seq_++;
+  if (fill_ == BLOCK_SAMPLES) {CloseBlock();}
+  return true;
+}
+
+void FlightRecorder::Freeze() {
+  if ((!buf_) || (frozen_)) {return;}
+  if (pending_) {FinishBlock();}
+  if (fill_) {
+    CloseBlock();
+    FinishBlock();
+  }
+  frozen_ = true;
+}
+
+void FlightRecorder::Resume() {
+  frozen_ = false;
+}
+
+uint32_t FlightRecorder::num_samples() const {
+  uint32_t num = 0;
+  size_t pos = tail_;
+  for (size_t i = 0; i < count_; i++) {
+    num += buf_[pos + NUM_POS];
+    pos = Next(pos);
+  }
+  return num;
+}
+
+bool FlightRecorder::Export(bool (*write)(const uint8_t * const, const size_t,
+                                          void *),
+                            void *context) const {
+  if ((!write) || (!frozen_)) {return false;}
+  size_t pos = tail_;
+  for (size_t i = 0; i < count_; i++) {
+    if (!write(buf_ + pos, Get16(buf_ + pos + LEN_POS), context)) {
+      return false;
+    }
+    pos = Next(pos);
+  }
+  return true;
+}
+
+size_t FlightRecorder::DecodeBlock(const uint8_t * const block,
+                                   const size_t len, int16_t (*cnts)[NUM_CH],
+                                   const size_t max,
+                                   uint32_t * const first_sample) {
+  if ((!block) || (!cnts) || (len < HEADER_SIZE)) {return 0;}
+  const size_t num = block[NUM_POS];
+  if ((num == 0) || (num > max) || (num > BLOCK_SAMPLES)) {return 0;}
+  const uint8_t * const width = block + WIDTH_POS;
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    if (width[ch] > MAX_WIDTH) {return 0;}
+  }
+  const size_t block_len = Get16(block + LEN_POS);
+  if ((block_len > len) || (block_len != BlockLen(width, num))) {return 0;}
+  if (first_sample) {
+    *first_sample = static_cast<uint32_t>(block[SEQ_POS]) |
+                    static_cast<uint32_t>(block[SEQ_POS + 1]) << 8 |
+                    static_cast<uint32_t>(block[SEQ_POS + 2]) << 16 |
+                    static_cast<uint32_t>(block[SEQ_POS + 3]) << 24;
+  }
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    cnts[0][ch] = static_cast<int16_t>(Get16(block + FIRST_POS + 2 * ch));
+  }
+  const uint8_t *p = block + HEADER_SIZE;
+  uint32_t acc = 0;
+  uint8_t num_bits = 0;
+  for (size_t i = 1; i < num; i++) {
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      while (num_bits < width[ch]) {
+        acc |= static_cast<uint32_t>(*p++) << num_bits;
+        num_bits += 8;
+      }
+      const uint32_t zz = acc & ((1u << width[ch]) - 1u);
+      acc >>= width[ch];
+      num_bits -= width[ch];
+      const int32_t d = static_cast<int32_t>(zz >> 1) ^
+                        -static_cast<int32_t>(zz & 1);
+      cnts[i][ch] = static_cast<int16_t>(cnts[i - 1][ch] + d);
+    }
+  }
+  return num;
+}
+
+void FlightRecorder::CloseBlock() {
+  /* The previous block is normally encoded by now */
+  if (pending_) {FinishBlock();}
+  const int16_t (* const s)[NUM_CH] = stage_[cur_];
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    enc_width_[ch] = Width(zz_or_[ch]);
+  }
+  const size_t len = BlockLen(enc_width_, fill_);
+  /* Blocks are contiguous, so drop what is past the end and start over */
+  if (head_ + len > size_) {
+    Evict(head_, size_);
+    end_ = head_;
+    head_ = 0;
+  }
+  Evict(head_, head_ + len);
+  if (count_ == 0) {tail_ = head_;}
+  uint8_t * const p = buf_ + head_;
+  Put16(static_cast<uint16_t>(len), p + LEN_POS);
+  const uint32_t first = seq_ - fill_;
+  Put16(static_cast<uint16_t>(first), p + SEQ_POS);
+  Put16(static_cast<uint16_t>(first >> 16), p + SEQ_POS + 2);
+  p[NUM_POS] = fill_;
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    Put16(static_cast<uint16_t>(s[0][ch]), p + FIRST_POS + 2 * ch);
+    p[WIDTH_POS + ch] = enc_width_[ch];
+  }
+  enc_pos_ = head_ + HEADER_SIZE;
+  enc_sample_ = 1;
+  enc_num_ = fill_;
+  acc_ = 0;
+  num_bits_ = 0;
+  head_ += len;
+  count_++;
+  used_ += len;
+  pending_ = true;
+  /* Collect the next block in the other stage */
+  cur_ ^= 1;
+  fill_ = 0;
+  if (enc_num_ == 1) {FinishBlock();}
+}
+
+void FlightRecorder::EncodeSample() {
+  const int16_t (* const s)[NUM_CH] = stage_[cur_ ^ 1];
+  const size_t i = enc_sample_;
+  for (size_t ch = 0; ch < NUM_CH; ch++) {
+    const uint8_t w = enc_width_[ch];
+    if (!w) {continue;}
+    acc_ |= ZigZag(static_cast<int32_t>(s[i][ch]) - s[i - 1][ch]) << num_bits_;
+    num_bits_ += w;
+    while (num_bits_ >= 8) {
+      buf_[enc_pos_++] = static_cast<uint8_t>(acc_);
+      acc_ >>= 8;
+      num_bits_ -= 8;
+    }
+  }
+  enc_sample_++;
+  if (enc_sample_ >= enc_num_) {
+    if (num_bits_) {buf_[enc_pos_++] = static_cast<uint8_t>(acc_);}
+    pending_ = false;
+  }
+}
+
+void FlightRecorder::FinishBlock() {
+  while (pending_) {
+    if (enc_sample_ >= enc_num_) {
+      pending_ = false;
+    } else {
+      EncodeSample();
+    }
+  }
+}
+
+void FlightRecorder::Evict(const size_t begin, const size_t end) {
+  while ((count_) && (tail_ >= begin) && (tail_ < end)) {
+    PopBlock();
+  }
+}
+
+void FlightRecorder::PopBlock() {
+  used_ -= Get16(buf_ + tail_ + LEN_POS);
+  tail_ = Next(tail_);
+  count_--;
+  /* The previous lap has been dropped */
+  if (tail_ == 0) {end_ = size_;}
+}
+
+size_t FlightRecorder::Next(const size_t pos) const {
+  const size_t next = pos + Get16(buf_ + pos + LEN_POS);
+  return (next >= end_) ? 0 : next;
+}
+
+}  // namespace bfs
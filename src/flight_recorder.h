@@ -0,0 +1,127 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_FLIGHT_RECORDER_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_FLIGHT_RECORDER_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+
+namespace bfs {
+
+/*
+* In-RAM recorder of the most recent raw IMU samples. Samples are collected
+* in blocks of 64, and each block is compressed as its first sample and the
+* differences between samples, bit-packed at the width the block needs.
+* Blocks go into a circular buffer, dropping the oldest when full, and each
+* can be decoded on its own. A block is encoded one sample per Add while the
+* next one is collected, so the time per sample is bounded.
+*
+* Block layout, little-endian: length (2 bytes), index of the first sample
+* (4), number of samples (1), first sample counts (2 per channel), delta
+* bit widths (1 per channel), then the zigzag encoded deltas, sample by
+* sample, LSB first.
+*/
+class FlightRecorder {
+ public:
+  /* Channels in FIFO order: accel x, y, z, temp, gyro x, y, z */
+  static constexpr size_t NUM_CH = 7;
+  static constexpr size_t BLOCK_SAMPLES = 64;
+  static constexpr size_t HEADER_SIZE = 7 + 3 * NUM_CH;
+  /* Deltas between int16 take up to 17 bits */
+  static constexpr size_t MAX_BLOCK_SIZE = HEADER_SIZE +
+    ((BLOCK_SAMPLES - 1) * NUM_CH * 17 + 7) / 8;
+  /* Storage owned by the caller, at least two blocks */
+  bool Config(uint8_t * const buf, const size_t size);
+  /* Adds raw counts, or a big-endian frame as read from the FIFO */
+  bool Add(const int16_t cnts[NUM_CH]);
+  bool AddFrame(const uint8_t * const frame);
+  /* Stops recording and encodes the partial block, so it can be exported */
+  void Freeze();
+  void Resume();
+  void Clear();
+  /*
+  * Passes each block to write, oldest first, while frozen. Stops and
+  * returns false if write returns false.
+  */
+  bool Export(bool (*write)(const uint8_t * const, const size_t, void *),
+              void *context) const;
+  /*
+  * Decodes one exported block into cnts, returning the number of samples or
+  * 0 if the block is invalid or has more than max samples.
+  */
+  static size_t DecodeBlock(const uint8_t * const block, const size_t len,
+                            int16_t (*cnts)[NUM_CH], const size_t max,
+                            uint32_t * const first_sample);
+  inline bool frozen() const {return frozen_;}
+  inline size_t num_blocks() const {return count_;}
+  inline size_t bytes_used() const {return used_;}
+  /* Samples held in the buffer */
+  uint32_t num_samples() const;
+
+ private:
+  uint8_t *buf_ = nullptr;
+  size_t size_ = 0;
+  /* Next write position, oldest block, and end of the previous lap */
+  size_t head_ = 0;
+  size_t tail_ = 0;
+  size_t end_ = 0;
+  size_t count_ = 0;
+  size_t used_ = 0;
+  bool frozen_ = false;
+  /* Index of the next sample added */
+  uint32_t seq_ = 0;
+  /* Block being collected, and the one being encoded */
+  int16_t stage_[2][BLOCK_SAMPLES][NUM_CH];
+  uint8_t cur_ = 0;
+  uint8_t fill_ = 0;
+  /* OR of the zigzag deltas, which has the width of the largest */
+  uint32_t zz_or_[NUM_CH];
+  /* Encoder state for the pending block */
+  bool pending_ = false;
+  uint8_t enc_sample_ = 0;
+  uint8_t enc_num_ = 0;
+  uint8_t enc_width_[NUM_CH];
+  size_t enc_pos_ = 0;
+  uint32_t acc_ = 0;
+  uint8_t num_bits_ = 0;
+  void CloseBlock();
+  void EncodeSample();
+  void FinishBlock();
+  void Evict(const size_t begin, const size_t end);
+  void PopBlock();
+  size_t Next(const size_t pos) const;
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_FLIGHT_RECORDER_H_ NOLINT
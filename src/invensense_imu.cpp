@@ -24,6 +24,9 @@
 */
 
 #include "invensense_imu.h"  // NOLINT
+#if defined(INVENSENSE_IMU_FAULT_INJECTION)
+#include "fault_injector.h"  // NOLINT
+#endif
 
 namespace bfs {
 
@@ -53,11 +56,35 @@ void InvensenseImu::Begin() {
 bool InvensenseImu::WriteRegister(const uint8_t reg, const uint8_t data,
                                   const int32_t spi_clock) {
   uint8_t ret_val;
+  WriteRegisterNoVerify(reg, data, spi_clock);
+  delay(10);
+  ReadRegisters(reg, sizeof(ret_val), spi_clock, &ret_val);
+  if (data == ret_val) {
+    return true;
+  } else {
+    return false;
+  }
+}
+
+bool InvensenseImu::WriteRegisterNoVerify(const uint8_t reg,
+                                          const uint8_t data,
+                                          const int32_t spi_clock) {
+  #if defined(INVENSENSE_IMU_FAULT_INJECTION)
+  int8_t fault;
+  if (!InjectFault(false, reg, &fault)) {return false;}
+  /* SPI writes are not acknowledged, a dropped write still succeeds */
+  if (fault == FaultInjector::FAULT_NACK) {return true;}
+  #endif
+  return WriteBus(reg, data, spi_clock);
+}
+
+bool InvensenseImu::WriteBus(const uint8_t reg, const uint8_t data,
+                             const int32_t spi_clock) {
   if (iface_ == I2C) {
     i2c_->beginTransmission(dev_);
     i2c_->write(reg);
     i2c_->write(data);
-    i2c_->endTransmission();
+    return (i2c_->endTransmission() == 0);
   } else {
     spi_->beginTransaction(SPISettings(spi_clock, MSBFIRST, SPI_MODE3));
     #if defined(TEENSYDUINO)
@@ -79,26 +106,57 @@ bool InvensenseImu::WriteRegister(const uint8_t reg, const uint8_t data,
       delayNanoseconds(125);
     #endif
     spi_->endTransaction();
-  }
-  delay(10);
-  ReadRegisters(reg, sizeof(ret_val), spi_clock, &ret_val);
-  if (data == ret_val) {
     return true;
+  }
+}
+
+bool InvensenseImu::WriteRegister(const uint8_t reg, const uint8_t data) {
+  if (iface_ == I2C) {
+    return WriteRegister(reg, data, 0);
   } else {
     return false;
   }
 }
 
+/* Data path, reachable from Read, see INVENSENSE_IMU_NO_SLEEP */
+INVENSENSE_IMU_NO_SLEEP
+
 bool InvensenseImu::ReadRegisters(const uint8_t reg, const uint8_t count,
                                   const int32_t spi_clock,
                                   uint8_t * const data) {
   if (!data) {return false;}
+  #if defined(INVENSENSE_IMU_FAULT_INJECTION)
+  int8_t fault;
+  if (!InjectFault(true, reg, &fault)) {return false;}
+  if (!ReadBus(reg, count, spi_clock, data)) {return false;}
+  if (!faults_) {return true;}
+  return faults_->Apply(static_cast<FaultInjector::Fault>(fault), reg, count,
+                        iface_ == I2C, data);
+  #else
+  return ReadBus(reg, count, spi_clock, data);
+  #endif
+}
+
+#if defined(INVENSENSE_IMU_FAULT_INJECTION)
+bool InvensenseImu::InjectFault(const bool read, const uint8_t reg,
+                                int8_t * const fault) {
+  *fault = FaultInjector::FAULT_NONE;
+  if (!faults_) {return true;}
+  *fault = faults_->Draw(read, reg);
+  /* An I2C NACK fails the transfer before any data moves */
+  return !((*fault == FaultInjector::FAULT_NACK) && (iface_ == I2C));
+}
+#endif
+
+bool InvensenseImu::ReadBus(const uint8_t reg, const uint8_t count,
+                            const int32_t spi_clock, uint8_t * const data) {
   if (iface_ == I2C) {
+    uint8_t bytes_rx;
     i2c_->beginTransmission(dev_);
     i2c_->write(reg);
     i2c_->endTransmission(false);
-    bytes_rx_ = i2c_->requestFrom(static_cast<uint8_t>(dev_), count);
-    if (bytes_rx_ == count) {
+    bytes_rx = i2c_->requestFrom(static_cast<uint8_t>(dev_), count);
+    if (bytes_rx == count) {
       for (size_t i = 0; i < count; i++) {
         data[i] = i2c_->read();
       }
@@ -131,14 +189,6 @@ bool InvensenseImu::ReadRegisters(const uint8_t reg, const uint8_t count,
   }
 }
 
-bool InvensenseImu::WriteRegister(const uint8_t reg, const uint8_t data) {
-  if (iface_ == I2C) {
-    return WriteRegister(reg, data, 0);
-  } else {
-    return false;
-  }
-}
-
 bool InvensenseImu::ReadRegisters(const uint8_t reg, const uint8_t count,
                                   uint8_t * const data) {
   if (iface_ == I2C) {
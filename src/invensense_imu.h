@@ -36,10 +36,33 @@
 #include "core/core.h"
 #endif
 
+/*
+* Methods reachable from Read may be called from an interrupt and never
+* sleep. INVENSENSE_IMU_ISR_SAFE only marks their declarations. Their
+* definitions follow INVENSENSE_IMU_NO_SLEEP, which poisons delay and
+* WriteRegister for the rest of the translation unit; a sleep reached
+* through a function defined elsewhere is caught by the host no_sleep_test.
+*/
+#define INVENSENSE_IMU_ISR_SAFE
+#if defined(__GNUC__)
+#define INVENSENSE_IMU_NO_SLEEP \
+  _Pragma("GCC poison delay delayMicroseconds WriteRegister")
+#else
+#define INVENSENSE_IMU_NO_SLEEP
+#endif
+
 namespace bfs {
 
+class FaultInjector;
+
 class InvensenseImu {
  public:
+  /*
+  * Longest read in one transfer. I2C reads are limited by the Wire receive
+  * buffer, which is 32 bytes on many platforms, e.g. AVR.
+  */
+  static constexpr uint8_t I2C_MAX_READ = 32;
+  static constexpr uint8_t SPI_MAX_READ = 255;
   InvensenseImu() {}
   InvensenseImu(TwoWire *i2c, const uint8_t addr) : i2c_(i2c),
                                                     dev_(addr),
@@ -50,13 +73,24 @@ class InvensenseImu {
   void Config(TwoWire *i2c, const uint8_t addr);
   void Config(SPIClass *spi, const uint8_t cs);
   void Begin();
+  INVENSENSE_IMU_ISR_SAFE
   bool ReadRegisters(const uint8_t reg, const uint8_t count,
                      const int32_t spi_clock, uint8_t * const data);
   bool WriteRegister(const uint8_t reg, const uint8_t data);
   bool WriteRegister(const uint8_t reg, const uint8_t data,
                      const int32_t spi_clock);
+  bool WriteRegisterNoVerify(const uint8_t reg, const uint8_t data,
+                             const int32_t spi_clock);
+  INVENSENSE_IMU_ISR_SAFE
   bool ReadRegisters(const uint8_t reg, const uint8_t count,
                      uint8_t * const data);
+  inline uint8_t max_read() const {
+    return (iface_ == I2C) ? I2C_MAX_READ : SPI_MAX_READ;
+  }
+  #if defined(INVENSENSE_IMU_FAULT_INJECTION)
+  /* Injects faults into every following transfer, nullptr to stop */
+  inline void ConfigFaults(FaultInjector * const faults) {faults_ = faults;}
+  #endif
 
  private:
   /* Communications interface */
@@ -68,9 +102,19 @@ class InvensenseImu {
   SPIClass *spi_;
   uint8_t dev_;
   Interface iface_;
-  uint8_t bytes_rx_;
   /* SPI flag to indicate a read operation */
   static constexpr uint8_t SPI_READ_ = 0x80;
+  /* Bus transfers, without fault injection */
+  bool WriteBus(const uint8_t reg, const uint8_t data,
+                const int32_t spi_clock);
+  INVENSENSE_IMU_ISR_SAFE
+  bool ReadBus(const uint8_t reg, const uint8_t count,
+               const int32_t spi_clock, uint8_t * const data);
+  #if defined(INVENSENSE_IMU_FAULT_INJECTION)
+  FaultInjector *faults_ = nullptr;
+  INVENSENSE_IMU_ISR_SAFE
+  bool InjectFault(const bool read, const uint8_t reg, int8_t * const fault);
+  #endif
 };
 
 }  // namespace bfs
@@ -36,159 +36,154 @@
 #include "core/core.h"
 #endif
 #include "invensense_imu.h"  // NOLINT
+#include "mpu_core.h"  // NOLINT
 
 namespace bfs {
 
-class Mpu9250 {
+class Mpu9250 : public MpuCore {
  public:
-  /* Sensor and filter settings */
-  enum I2cAddr : uint8_t {
-    I2C_ADDR_PRIM = 0x68,
-    I2C_ADDR_SEC = 0x69
-  };
-  enum DlpfBandwidth : int8_t {
-    DLPF_BANDWIDTH_184HZ = 0x01,
-    DLPF_BANDWIDTH_92HZ = 0x02,
-    DLPF_BANDWIDTH_41HZ = 0x03,
-    DLPF_BANDWIDTH_20HZ = 0x04,
-    DLPF_BANDWIDTH_10HZ = 0x05,
-    DLPF_BANDWIDTH_5HZ = 0x06
-  };
-  enum AccelRange : int8_t {
-    ACCEL_RANGE_2G = 0x00,
-    ACCEL_RANGE_4G = 0x08,
-    ACCEL_RANGE_8G = 0x10,
-    ACCEL_RANGE_16G = 0x18
-  };
-  enum GyroRange : int8_t {
-    GYRO_RANGE_250DPS = 0x00,
-    GYRO_RANGE_500DPS = 0x08,
-    GYRO_RANGE_1000DPS = 0x10,
-    GYRO_RANGE_2000DPS = 0x18
-  };
-  enum WomRate : int8_t {
-    WOM_RATE_0_24HZ = 0x00,
-    WOM_RATE_0_49HZ = 0x01,
-    WOM_RATE_0_98HZ = 0x02,
-    WOM_RATE_1_95HZ = 0x03,
-    WOM_RATE_3_91HZ = 0x04,
-    WOM_RATE_7_81HZ = 0x05,
-    WOM_RATE_15_63HZ = 0x06,
-    WOM_RATE_31_25HZ = 0x07,
-    WOM_RATE_62_50HZ = 0x08,
-    WOM_RATE_125HZ = 0x09,
-    WOM_RATE_250HZ = 0x0A,
-    WOM_RATE_500HZ = 0x0B
-  };
   Mpu9250() {}
-  Mpu9250(TwoWire *i2c, const I2cAddr addr) :
-          imu_(i2c, static_cast<uint8_t>(addr)) {}
-  Mpu9250(SPIClass *spi, const uint8_t cs) :
-          imu_(spi, cs) {}
-  void Config(TwoWire *i2c, const I2cAddr addr);
-  void Config(SPIClass *spi, const uint8_t cs);
+  Mpu9250(TwoWire *i2c, const I2cAddr addr) : MpuCore(i2c, addr) {}
+  Mpu9250(SPIClass *spi, const uint8_t cs) : MpuCore(spi, cs) {}
   bool Begin();
-  bool EnableDrdyInt();
-  bool DisableDrdyInt();
-  bool ConfigAccelRange(const AccelRange range);
-  inline AccelRange accel_range() const {return accel_range_;}
-  bool ConfigGyroRange(const GyroRange range);
-  inline GyroRange gyro_range() const {return gyro_range_;}
+  bool StartBegin();
+  INVENSENSE_IMU_ISR_SAFE bool Read();
+  using MpuCore::Read;
+  inline bool ReadRaw() {return ReadRawBuffer(DATA_BUF_SIZE_);}
+  inline bool EnableDualPath() {return ConfigDualPath(DeferredRead);}
+  #if !defined(INVENSENSE_IMU_NO_MAG)
   bool ConfigSrd(const uint8_t srd);
-  inline uint8_t srd() const {return srd_;}
-  bool ConfigDlpfBandwidth(const DlpfBandwidth dlpf);
-  inline DlpfBandwidth dlpf_bandwidth() const {return dlpf_bandwidth_;}
+  bool StartConfigSrd(const uint8_t srd);
+  #if !defined(INVENSENSE_IMU_NO_WOM)
   bool EnableWom(int16_t threshold_mg, const WomRate wom_rate);
+  bool CalibrateWom(const float noise_mult, const WomRate wom_rate,
+                    const uint32_t duration_ms, WomCal * const cal);
+  bool EnableShockCapture(const int16_t threshold_mg);
+  #endif
   void Reset();
-  bool Read();
-  inline bool new_imu_data() const {return new_imu_data_;}
-  inline float accel_x_mps2() const {return accel_[0];}
-  inline float accel_y_mps2() const {return accel_[1];}
-  inline float accel_z_mps2() const {return accel_[2];}
-  inline float gyro_x_radps() const {return gyro_[0];}
-  inline float gyro_y_radps() const {return gyro_[1];}
-  inline float gyro_z_radps() const {return gyro_[2];}
+  /* Include the AK8963 registers */
+  bool DumpRegisters(RegisterDump * const dump);
+  void ExpectedRegisters(RegisterDump * const expected) const;
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  /* Magnetometer sample, as passed to the new mag data callback */
+  struct MagSample {
+    float mag_x_ut;
+    float mag_y_ut;
+    float mag_z_ut;
+  };
+  using MagCallback = void (*)(const MagSample &sample, void *context);
+  using EventCallback = void (*)(void *context);
+  inline void OnNewMagData(MagCallback cb, void * const context) {
+    mag_cb_ = cb;
+    mag_cb_context_ = context;
+  }
+  template<class T, void (T::*Method)(const MagSample &)>
+  inline void OnNewMagData(T * const obj) {
+    OnNewMagData([](const MagSample &sample, void *context) {
+      (static_cast<T *>(context)->*Method)(sample);
+    }, obj);
+  }
+  inline void OnMagOverflow(EventCallback cb, void * const context) {
+    mag_overflow_cb_ = cb;
+    mag_overflow_cb_context_ = context;
+  }
+  template<class T, void (T::*Method)()>
+  inline void OnMagOverflow(T * const obj) {
+    OnMagOverflow([](void *context) {
+      (static_cast<T *>(context)->*Method)();
+    }, obj);
+  }
+  #endif
   inline bool new_mag_data() const {return new_mag_data_;}
+  #if defined(INVENSENSE_IMU_COMPACT)
+  inline float mag_x_ut() const {
+    return static_cast<float>(mag_cnts_[0]) * mag_scale_[0];
+  }
+  inline float mag_y_ut() const {
+    return static_cast<float>(mag_cnts_[1]) * mag_scale_[1];
+  }
+  inline float mag_z_ut() const {
+    return static_cast<float>(mag_cnts_[2]) * mag_scale_[2];
+  }
+  #elif defined(INVENSENSE_IMU_LAZY)
+  inline float mag_x_ut() const {
+    if (mag_dirty_ & MAG_X_DIRTY_) {ConvertMag(0);}
+    return mag_[0];
+  }
+  inline float mag_y_ut() const {
+    if (mag_dirty_ & MAG_Y_DIRTY_) {ConvertMag(1);}
+    return mag_[1];
+  }
+  inline float mag_z_ut() const {
+    if (mag_dirty_ & MAG_Z_DIRTY_) {ConvertMag(2);}
+    return mag_[2];
+  }
+  #else
   inline float mag_x_ut() const {return mag_[0];}
   inline float mag_y_ut() const {return mag_[1];}
   inline float mag_z_ut() const {return mag_[2];}
-  inline float die_temp_c() const {return temp_;}
+  #endif
+  #endif
 
  private:
-  InvensenseImu imu_;
-  int32_t spi_clock_;
-  /*
-  * MPU-9250 supports an SPI clock of 1 MHz for config and 20 MHz for reading
-  * data; however, in testing we found that 20 MHz was sometimes too fast and
-  * scaled this down to 15 MHz, which consistently worked well.
-  */
-  static constexpr int32_t SPI_CFG_CLOCK_ = 1000000;
-  static constexpr int32_t SPI_READ_CLOCK_ = 15000000;
   /* Configuration */
-  AccelRange accel_range_, requested_accel_range_;
-  GyroRange gyro_range_, requested_gyro_range_;
-  DlpfBandwidth dlpf_bandwidth_, requested_dlpf_;
-  float accel_scale_, requested_accel_scale_;
-  float gyro_scale_, requested_gyro_scale_;
-  uint8_t srd_;
-  static constexpr float TEMP_SCALE_ = 333.87f;
-  uint8_t asa_buff_[3];
-  float mag_scale_[3];
-  uint8_t who_am_i_;
   static constexpr uint8_t WHOAMI_MPU9250_ = 0x71;
   static constexpr uint8_t WHOAMI_MPU9255_ = 0x73;
+  /* Non-blocking sequences, run by the MpuCore sequence engine */
+  friend class MpuAsync;
+  friend class MpuTiming;
+  static const Op BEGIN_SEQ_[];
+  /* Control path read, run directly or deferred in dual path mode */
+  INVENSENSE_IMU_ISR_SAFE bool ReadLatest();
+  INVENSENSE_IMU_ISR_SAFE static bool DeferredRead(MpuCore * const core);
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  static const Op SRD_MEAS1_SEQ_[];
+  static const Op SRD_MEAS2_SEQ_[];
+  static const Op AUX_WRITE_SEQ_[];
+  static const Op AUX_READ_SEQ_[];
+  static constexpr uint8_t HOOK_ASA_ = HOOK_DERIVED_;
+  static bool SeqHook(MpuCore * const core, const uint8_t id);
+  bool StartWriteAk8963Register(const uint8_t reg, const uint8_t data);
+  bool StartReadAk8963Registers(const uint8_t reg, const uint8_t count);
+  #endif
+  #if defined(INVENSENSE_IMU_NO_MAG)
+  /* Data */
+  static constexpr uint8_t DATA_BUF_SIZE_ = 15;
+  #if !defined(INVENSENSE_IMU_COMPACT)
+  uint8_t data_buf_[DATA_BUF_SIZE_];
+  #endif
+  #else
+  float mag_scale_[3];
   static constexpr uint8_t WHOAMI_AK8963_ = 0x48;
   /* Data */
-  static constexpr float G_MPS2_ = 9.80665f;
-  static constexpr float DEG2RAD_ = 3.14159265358979323846264338327950288f /
-                                    180.0f;
-  bool new_imu_data_, new_mag_data_;
+  static constexpr uint8_t DATA_BUF_SIZE_ = 23;
+  bool new_mag_data_;
   bool mag_sensor_overflow_;
-  uint8_t mag_data_[8];
-  uint8_t data_buf_[23];
-  int16_t accel_cnts_[3], gyro_cnts_[3], temp_cnts_, mag_cnts_[3];
-  float accel_[3], gyro_[3], mag_[3];
-  float temp_;
+  #if !defined(INVENSENSE_IMU_COMPACT)
+  uint8_t data_buf_[DATA_BUF_SIZE_];
+  #endif
+  #if defined(INVENSENSE_IMU_LAZY)
+  mutable uint8_t mag_dirty_;
+  mutable float mag_[3];
+  static constexpr uint8_t MAG_X_DIRTY_ = 0x01;
+  static constexpr uint8_t MAG_Y_DIRTY_ = 0x02;
+  static constexpr uint8_t MAG_Z_DIRTY_ = 0x04;
+  static constexpr uint8_t MAG_ALL_DIRTY_ = 0x07;
+  #elif !defined(INVENSENSE_IMU_COMPACT)
+  float mag_[3];
+  #endif
+  int16_t mag_cnts_[3];
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  MagCallback mag_cb_ = nullptr;
+  void *mag_cb_context_ = nullptr;
+  EventCallback mag_overflow_cb_ = nullptr;
+  void *mag_overflow_cb_context_ = nullptr;
+  #endif
   /* Registers */
-  static constexpr uint8_t PWR_MGMNT_1_ = 0x6B;
-  static constexpr uint8_t H_RESET_ = 0x80;
-  static constexpr uint8_t CLKSEL_PLL_ = 0x01;
-  static constexpr uint8_t WHOAMI_ = 0x75;
-  static constexpr uint8_t ACCEL_CONFIG_ = 0x1C;
-  static constexpr uint8_t GYRO_CONFIG_ = 0x1B;
-  static constexpr uint8_t ACCEL_CONFIG2_ = 0x1D;
-  static constexpr uint8_t CONFIG_ = 0x1A;
-  static constexpr uint8_t SMPLRT_DIV_ = 0x19;
-  static constexpr uint8_t INT_PIN_CFG_ = 0x37;
-  static constexpr uint8_t INT_ENABLE_ = 0x38;
-  static constexpr uint8_t INT_DISABLE_ = 0x00;
-  static constexpr uint8_t INT_PULSE_50US_ = 0x00;
-  static constexpr uint8_t INT_RAW_RDY_EN_ = 0x01;
-  static constexpr uint8_t INT_STATUS_ = 0x3A;
-  static constexpr uint8_t RAW_DATA_RDY_INT_ = 0x01;
-  static constexpr uint8_t USER_CTRL_ = 0x6A;
   static constexpr uint8_t I2C_MST_EN_ = 0x20;
   static constexpr uint8_t I2C_MST_CLK_ = 0x0D;
   static constexpr uint8_t I2C_MST_CTRL_ = 0x24;
-  static constexpr uint8_t I2C_SLV0_ADDR_ = 0x25;
-  static constexpr uint8_t I2C_SLV0_REG_ = 0x26;
-  static constexpr uint8_t I2C_SLV0_CTRL_ = 0x27;
-  static constexpr uint8_t I2C_SLV0_DO_ = 0x63;
-  static constexpr uint8_t I2C_READ_FLAG_ = 0x80;
-  static constexpr uint8_t I2C_SLV0_EN_ = 0x80;
-  static constexpr uint8_t EXT_SENS_DATA_00_ = 0x49;
-  /* Needed for WOM */
-  static constexpr uint8_t INT_WOM_EN_ = 0x40;
-  static constexpr uint8_t PWR_MGMNT_2_ = 0x6C;
-  static constexpr uint8_t DISABLE_GYRO_ = 0x07;
-  static constexpr uint8_t MOT_DETECT_CTRL_ = 0x69;
-  static constexpr uint8_t ACCEL_INTEL_EN_ = 0x80;
-  static constexpr uint8_t ACCEL_INTEL_MODE_ = 0x40;
-  static constexpr uint8_t LP_ACCEL_ODR_ = 0x1E;
-  static constexpr uint8_t WOM_THR_ = 0x1F;
-  static constexpr uint8_t PWR_CYCLE_WOM_ = 0x20;
   /* AK8963 registers */
-  static constexpr uint8_t AK8963_I2C_ADDR_ = 0x0C;
   static constexpr uint8_t AK8963_ST1_ = 0x02;
   static constexpr uint8_t AK8963_DATA_RDY_INT_ = 0x01;
   static constexpr uint8_t AK8963_HXL_ = 0x03;
@@ -203,12 +198,12 @@ class Mpu9250 {
   static constexpr uint8_t AK8963_WHOAMI_ = 0x00;
   static constexpr uint8_t AK8963_HOFL_ = 0x08;
   /* Utility functions */
-  bool WriteRegister(const uint8_t reg, const uint8_t data);
-  bool ReadRegisters(const uint8_t reg, const uint8_t count,
-                     uint8_t * const data);
   bool WriteAk8963Register(const uint8_t reg, const uint8_t data);
-  bool ReadAk8963Registers(const uint8_t reg, const uint8_t count,
-                           uint8_t * const data);
+  void SetMagScale(const uint8_t * const asa);
+  #if defined(INVENSENSE_IMU_LAZY)
+  INVENSENSE_IMU_ISR_SAFE void ConvertMag(const uint8_t axis) const;
+  #endif
+  #endif
 };
 
 }  // namespace bfs
@@ -0,0 +1,206 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_MPU_ASYNC_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_MPU_ASYNC_H_
+
+/* Coroutines require C++20 */
+#if defined(__cpp_impl_coroutine)
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+#include <coroutine>  // NOLINT
+#include <exception>  // NOLINT
+#include "mpu6500.h"  // NOLINT
+#include "mpu9250.h"  // NOLINT
+
+namespace bfs {
+
+/*
+* Lazily started coroutine returning a T. Awaiting a task runs it and resumes
+* the awaiting coroutine when it completes; a top level task is run with
+* Start and polled with done.
+*/
+template<typename T>
+class MpuTask {
+ public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {return false;}
+    std::coroutine_handle<> await_suspend(Handle h) noexcept {
+      if (h.promise().continuation_) {return h.promise().continuation_;}
+      return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+  struct promise_type {
+    T value_{};
+    std::coroutine_handle<> continuation_;
+    MpuTask get_return_object() {
+      return MpuTask(Handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept {return {};}
+    FinalAwaiter final_suspend() const noexcept {return {};}
+    void return_value(const T val) {value_ = val;}
+    void unhandled_exception() {std::terminate();}
+  };
+  explicit MpuTask(const Handle h) : handle_(h) {}
+  MpuTask(const MpuTask &) = delete;
+  MpuTask &operator=(const MpuTask &) = delete;
+  MpuTask(MpuTask &&other) noexcept : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+  MpuTask &operator=(MpuTask &&other) noexcept {
+    if (this != &other) {
+      if (handle_) {handle_.destroy();}
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+  ~MpuTask() {
+    if (handle_) {handle_.destroy();}
+  }
+  /* Runs a top level task until its first suspension */
+  void Start() {
+    if (handle_ && !handle_.done()) {handle_.resume();}
+  }
+  inline bool done() const {return !handle_ || handle_.done();}
+  inline T result() const {return handle_.promise().value_;}
+  /* Awaiting from another coroutine */
+  bool await_ready() const noexcept {return done();}
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    handle_.promise().continuation_ = caller;
+    return handle_;
+  }
+  T await_resume() const {return handle_.promise().value_;}
+
+ private:
+  Handle handle_;
+};
+
+/*
+* Awaitable driver interface for cooperative schedulers. Every bus transfer
+* and every delay of the blocking methods is a suspension point, so one
+* thread can interleave any number of sensors. Sched is the caller's
+* scheduler and must provide Sleep(uint32_t ms), returning an awaitable that
+* resumes the coroutine after ms milliseconds; a Sleep(0) is a yield.
+*/
+class MpuAsync {
+ public:
+  template<class Imu, class Sched>
+  static MpuTask<bool> Begin(Imu &imu, Sched &sched) {
+    if (!imu.StartBegin()) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  template<class Imu, class Sched>
+  static MpuTask<bool> ConfigAccelRange(Imu &imu,
+                                        const MpuCore::AccelRange range,
+                                        Sched &sched) {
+    if (!imu.StartConfigAccelRange(range)) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  template<class Imu, class Sched>
+  static MpuTask<bool> ConfigGyroRange(Imu &imu,
+                                       const MpuCore::GyroRange range,
+                                       Sched &sched) {
+    if (!imu.StartConfigGyroRange(range)) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  template<class Imu, class Sched>
+  static MpuTask<bool> ConfigDlpfBandwidth(Imu &imu,
+                                           const MpuCore::DlpfBandwidth dlpf,
+                                           Sched &sched) {
+    if (!imu.StartConfigDlpfBandwidth(dlpf)) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  template<class Imu, class Sched>
+  static MpuTask<bool> ConfigSrd(Imu &imu, const uint8_t srd, Sched &sched) {
+    if (!imu.StartConfigSrd(srd)) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  /* A single burst read, yielding to the scheduler afterwards */
+  template<class Imu, class Sched>
+  static MpuTask<bool> Read(Imu &imu, Sched &sched) {
+    const bool status = imu.Read();
+    co_await sched.Sleep(0);
+    co_return status;
+  }
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  template<class Sched>
+  static MpuTask<bool> WriteAk8963Register(Mpu9250 &imu, const uint8_t reg,
+                                           const uint8_t data, Sched &sched) {
+    if (!imu.StartWriteAk8963Register(reg, data)) {co_return false;}
+    co_return co_await Run(imu, sched);
+  }
+  /* Reads up to 8 registers */
+  template<class Sched>
+  static MpuTask<bool> ReadAk8963Registers(Mpu9250 &imu, const uint8_t reg,
+                                           const uint8_t count,
+                                           uint8_t * const data,
+                                           Sched &sched) {
+    if (!data) {co_return false;}
+    if (!imu.StartReadAk8963Registers(reg, count)) {co_return false;}
+    const bool status = co_await Run(imu, sched);
+    if (!status) {co_return false;}
+    for (uint8_t i = 0; i < count; i++) {
+      data[i] = imu.seq_buf_[i];
+    }
+    co_return true;
+  }
+  #endif
+
+ private:
+  /* Steps the sequence, sleeping through its waits */
+  template<class Sched>
+  static MpuTask<bool> Run(MpuCore &imu, Sched &sched) {
+    while (1) {
+      switch (imu.Poll()) {
+        case MpuCore::POLL_DONE: {
+          co_return true;
+        }
+        case MpuCore::POLL_FAILED: {
+          co_return false;
+        }
+        default: {
+          co_await sched.Sleep(imu.seq_wait_remaining_ms());
+          break;
+        }
+      }
+    }
+  }
+};
+
+}  // namespace bfs
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // INVENSENSE_IMU_SRC_MPU_ASYNC_H_ NOLINT
@@ -0,0 +1,320 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu_batch.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace bfs {
+
+namespace {
+/* Channels in FIFO order: accel x, y, z, temp, gyro x, y, z */
+constexpr size_t NUM_CH = 7;
+/* Die temperature, (cnts - 21) / 333.87 + 21 as a gain and offset */
+constexpr float TEMP_GAIN = 1.0f / 333.87f;
+constexpr float TEMP_OFFSET = 21.0f - 21.0f / 333.87f;
+/* Int16 range, as floats for clamping before the conversion */
+constexpr float INT16_MAX_F = 32767.0f;
+constexpr float INT16_MIN_F = -32768.0f;
+
+int16_t ToInt16(const float val) {
+  /*
+  * Saturate before rounding, comparing this way also saturates NaN, same as
+  * the SSE2 path. lrintf rounds to nearest even and, unlike nearbyintf, is
+  * in avr-libc.
+  */
+  if (!(val < INT16_MAX_F)) {return static_cast<int16_t>(INT16_MAX_F);}
+  if (val < INT16_MIN_F) {return static_cast<int16_t>(INT16_MIN_F);}
+  return static_cast<int16_t>(lrintf(val));
+}
+
+#if !defined(__SSE2__) && defined(__ARM_NEON)
+/* ToInt16 for four values, before the saturating narrow */
+int32x4_t ToInt16x4(const float32x4_t val) {
+  const float32x4_t vmax = vdupq_n_f32(INT16_MAX_F);
+  const float32x4_t cnt = vmaxq_f32(vbslq_f32(vcltq_f32(val, vmax), val, vmax),
+                                    vdupq_n_f32(INT16_MIN_F));
+  #if defined(__aarch64__)
+  return vcvtnq_s32_f32(cnt);
+  #else
+  /*
+  * ARMv7 only truncates, adding and subtracting 1.5 * 2^23 first rounds to
+  * the nearest even, as NEON always rounds to nearest
+  */
+  const float32x4_t round = vdupq_n_f32(12582912.0f);
+  return vcvtq_s32_f32(vsubq_f32(vaddq_f32(cnt, round), round));
+  #endif
+}
+#endif
+
+/* IEEE single to half precision, rounding to nearest even */
+uint16_t FloatToHalf(const float val) {
+  uint32_t x;
+  memcpy(&x, &val, sizeof(x));
+  const uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000u);
+  x &= 0x7FFFFFFFu;
+  /* Infinity, or NaN kept quiet */
+  if (x >= 0x7F800000u) {
+    return sign | 0x7C00u | ((x > 0x7F800000u) ? 0x0200u : 0u);
+  }
+  /* 65520 and above round to infinity */
+  if (x >= 0x477FF000u) {return sign | 0x7C00u;}
+  /* Below 2^-14 is subnormal, in units of 2^-24 */
+  if (x < 0x38800000u) {
+    return sign | static_cast<uint16_t>(lrintf(fabsf(val) * 16777216.0f));
+  }
+  /* Rebias the exponent from 127 to 15 and round the mantissa to 10 bits */
+  const uint32_t r = x - 0x38000000u;
+  return sign | static_cast<uint16_t>((r + 0x0FFFu + ((r >> 13) & 1u)) >> 13);
+}
+
+float HalfToFloat(const uint16_t val) {
+  const uint32_t sign = static_cast<uint32_t>(val & 0x8000u) << 16;
+  const uint32_t exp = (val >> 10) & 0x1Fu;
+  const uint32_t man = val & 0x03FFu;
+  if (exp == 0) {
+    const float f = static_cast<float>(man) * (1.0f / 16777216.0f);
+    return sign ? -f : f;
+  }
+  const uint32_t x = (exp == 0x1Fu) ? (sign | 0x7F800000u | (man << 13)) :
+                     (sign | ((exp + 112u) << 23) | (man << 13));
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+}  // namespace
+
+void UnpackImuFrames(const uint8_t * const frames, const size_t num_frames,
+                     const float accel_scale_mps2, const float gyro_scale_radps,
+                     ImuFrameArrays * const out) {
+  if ((!frames) || (!out)) {return;}
+  /*
+  * Destination, scale, and offset for each FIFO channel. The sensor x and y
+  * axes are swapped and z is negated, same as in Read.
+  */
+  float * const dst[NUM_CH] = {
+    out->accel_y_mps2, out->accel_x_mps2, out->accel_z_mps2, out->die_temp_c,
+    out->gyro_y_radps, out->gyro_x_radps, out->gyro_z_radps
+  };
+  const float scale[NUM_CH] = {
+    accel_scale_mps2, accel_scale_mps2, -accel_scale_mps2, TEMP_GAIN,
+    gyro_scale_radps, gyro_scale_radps, -gyro_scale_radps
+  };
+  const float offset[NUM_CH] = {
+    0.0f, 0.0f, 0.0f, TEMP_OFFSET, 0.0f, 0.0f, 0.0f
+  };
+  size_t i = 0;
+  /*
+  * The vector paths convert 4 frames at a time with a 16 byte load per
+  * frame, which reads 2 bytes past the frame, so they stop one frame early
+  * to stay inside the buffer.
+  */
+  #if defined(__SSE2__)
+  for (; i + 4 < num_frames; i += 4) {
+    const uint8_t *p = frames + i * IMU_FRAME_SIZE;
+    __m128i r[4];
+    for (size_t k = 0; k < 4; k++) {
+      const __m128i v = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(p + k * IMU_FRAME_SIZE));
+      /* Byte swap each int16 lane */
+      r[k] = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+    /* Transpose, so each half register holds one channel of 4 frames */
+    const __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+    const __m128i t1 = _mm_unpackhi_epi16(r[0], r[1]);
+    const __m128i t2 = _mm_unpacklo_epi16(r[2], r[3]);
+    const __m128i t3 = _mm_unpackhi_epi16(r[2], r[3]);
+    const __m128i u[4] = {
+      _mm_unpacklo_epi32(t0, t2), _mm_unpackhi_epi32(t0, t2),
+      _mm_unpacklo_epi32(t1, t3), _mm_unpackhi_epi32(t1, t3)
+    };
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      if (!dst[ch]) {continue;}
+      /* Sign extend to int32 by shifting the duplicated lane down */
+      const __m128i c = (ch & 1) ?
+        _mm_srai_epi32(_mm_unpackhi_epi16(u[ch / 2], u[ch / 2]), 16) :
+        _mm_srai_epi32(_mm_unpacklo_epi16(u[ch / 2], u[ch / 2]), 16);
+      const __m128 f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(c),
+                                             _mm_set1_ps(scale[ch])),
+                                  _mm_set1_ps(offset[ch]));
+      _mm_storeu_ps(dst[ch] + i, f);
+    }
+  }
+  #elif defined(__ARM_NEON)
+  for (; i + 4 < num_frames; i += 4) {
+    const uint8_t *p = frames + i * IMU_FRAME_SIZE;
+    int16x8_t r[4];
+    for (size_t k = 0; k < 4; k++) {
+      /* Byte swap each int16 lane */
+      r[k] = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(p + k * IMU_FRAME_SIZE)));
+    }
+    /* Transpose, so each half register holds one channel of 4 frames */
+    const int16x8x2_t t01 = vzipq_s16(r[0], r[1]);
+    const int16x8x2_t t23 = vzipq_s16(r[2], r[3]);
+    const int32x4x2_t u01 = vzipq_s32(vreinterpretq_s32_s16(t01.val[0]),
+                                      vreinterpretq_s32_s16(t23.val[0]));
+    const int32x4x2_t u23 = vzipq_s32(vreinterpretq_s32_s16(t01.val[1]),
+                                      vreinterpretq_s32_s16(t23.val[1]));
+    const int16x8_t u[4] = {
+      vreinterpretq_s16_s32(u01.val[0]), vreinterpretq_s16_s32(u01.val[1]),
+      vreinterpretq_s16_s32(u23.val[0]), vreinterpretq_s16_s32(u23.val[1])
+    };
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      if (!dst[ch]) {continue;}
+      const int32x4_t c = (ch & 1) ? vmovl_s16(vget_high_s16(u[ch / 2])) :
+                                     vmovl_s16(vget_low_s16(u[ch / 2]));
+      const float32x4_t f = vaddq_f32(vmulq_n_f32(vcvtq_f32_s32(c),
+                                                  scale[ch]),
+                                      vdupq_n_f32(offset[ch]));
+      vst1q_f32(dst[ch] + i, f);
+    }
+  }
+  #endif
+  /* Scalar loop for the remaining frames, or all of them without SIMD */
+  for (; i < num_frames; i++) {
+    const uint8_t *p = frames + i * IMU_FRAME_SIZE;
+    for (size_t ch = 0; ch < NUM_CH; ch++) {
+      if (!dst[ch]) {continue;}
+      const int16_t cnts = static_cast<int16_t>(p[2 * ch]) << 8 | p[2 * ch + 1];
+      dst[ch][i] = static_cast<float>(cnts) * scale[ch] + offset[ch];
+    }
+  }
+}
+
+void PackInt16(const float * const in, const size_t num, const float scale,
+               int16_t * const out) {
+  if ((!in) || (!out)) {return;}
+  const float inv = 1.0f / scale;
+  size_t i = 0;
+  #if defined(__SSE2__)
+  const __m128 vinv = _mm_set1_ps(inv);
+  const __m128 vmax = _mm_set1_ps(INT16_MAX_F);
+  const __m128 vmin = _mm_set1_ps(INT16_MIN_F);
+  for (; i + 8 <= num; i += 8) {
+    /* Clamp first, the conversion overflows to the minimum */
+    const __m128 a = _mm_max_ps(_mm_min_ps(
+      _mm_mul_ps(_mm_loadu_ps(in + i), vinv), vmax), vmin);
+    const __m128 b = _mm_max_ps(_mm_min_ps(
+      _mm_mul_ps(_mm_loadu_ps(in + i + 4), vinv), vmax), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+  }
+  #elif defined(__ARM_NEON)
+  for (; i + 8 <= num; i += 8) {
+    const int32x4_t a = ToInt16x4(vmulq_n_f32(vld1q_f32(in + i), inv));
+    const int32x4_t b = ToInt16x4(vmulq_n_f32(vld1q_f32(in + i + 4), inv));
+    vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  #endif
+  for (; i < num; i++) {
+    out[i] = ToInt16(in[i] * inv);
+  }
+}
+
+void UnpackInt16(const int16_t * const in, const size_t num, const float scale,
+                 float * const out) {
+  if ((!in) || (!out)) {return;}
+  size_t i = 0;
+  #if defined(__SSE2__)
+  const __m128 vscale = _mm_set1_ps(scale);
+  for (; i + 8 <= num; i += 8) {
+    const __m128i v = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(in + i));
+    /* Sign extend to int32 by shifting the duplicated lane down */
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+  }
+  #elif defined(__ARM_NEON)
+  for (; i + 8 <= num; i += 8) {
+    const int16x8_t v = vld1q_s16(in + i);
+    vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),
+                                   scale));
+    vst1q_f32(out + i + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+  }
+  #endif
+  for (; i < num; i++) {
+    out[i] = static_cast<float>(in[i]) * scale;
+  }
+}
+
+void PackFp16(const float * const in, const size_t num, uint16_t * const out) {
+  if ((!in) || (!out)) {return;}
+  size_t i = 0;
+  #if defined(__F16C__)
+  for (; i + 8 <= num; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                                     _MM_FROUND_TO_NEAREST_INT));
+  }
+  #elif defined(__aarch64__)
+  for (; i + 4 <= num; i += 4) {
+    vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in + i))));
+  }
+  #endif
+  for (; i < num; i++) {
+    out[i] = FloatToHalf(in[i]);
+  }
+}
+
+void UnpackFp16(const uint16_t * const in, const size_t num,
+                float * const out) {
+  if ((!in) || (!out)) {return;}
+  size_t i = 0;
+  #if defined(__F16C__)
+  for (; i + 8 <= num; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(in + i))));
+  }
+  #elif defined(__aarch64__)
+  for (; i + 4 <= num; i += 4) {
+    vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in + i))));
+  }
+  #endif
+  for (; i < num; i++) {
+    out[i] = HalfToFloat(in[i]);
+  }
+}
+
+}  // namespace bfs
@@ -0,0 +1,104 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_MPU_BATCH_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_MPU_BATCH_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+
+namespace bfs {
+
+/*
+* Structure-of-arrays destination for UnpackImuFrames. Each pointer must
+* reference an array of at least num_frames floats; a nullptr skips that
+* channel. Axes are in the same frame as the Mpu6500 and Mpu9250 accessors.
+*/
+struct ImuFrameArrays {
+  float *accel_x_mps2;
+  float *accel_y_mps2;
+  float *accel_z_mps2;
+  float *gyro_x_radps;
+  float *gyro_y_radps;
+  float *gyro_z_radps;
+  float *die_temp_c;
+};
+
+/* Size of a FIFO frame: accel, temp, and gyro in register order */
+static constexpr size_t IMU_FRAME_SIZE = 14;
+
+/*
+* Per count scales for a full scale range given in g and deg/s, e.g. 16 and
+* 2000. These are the accel_scale_mps2 and gyro_scale_radps of a sensor at
+* that range, computed the same way as the driver's range tables, for code
+* converting frames without a sensor object.
+*/
+constexpr float AccelScaleMps2(const float range_g) {
+  return range_g / 32767.5f * 9.80665f;
+}
+constexpr float GyroScaleRadps(const float range_dps) {
+  return range_dps / 32767.5f *
+         (3.14159265358979323846264338327950288f / 180.0f);
+}
+
+/*
+* Converts num_frames big-endian frames, packed back to back, to engineering
+* units. The accel and gyro scales are per count, i.e. the accel_scale_mps2
+* and gyro_scale_radps of the sensor object at the time the frames were
+* sampled. Uses SSE2 on x86 and NEON on ARM when available, otherwise a
+* scalar loop.
+*/
+void UnpackImuFrames(const uint8_t * const frames, const size_t num_frames,
+                     const float accel_scale_mps2, const float gyro_scale_radps,
+                     ImuFrameArrays * const out);
+
+/*
+* Compact formats for history and multi-sensor buffers, 2 bytes per value
+* instead of 4. Int16 values share one per count scale for a block, stored
+* once alongside it as in ShockEvent; using the sensor's scale stores
+* converted counts exactly. Fp16 is IEEE half precision, which needs no
+* scale and keeps 11 significant bits over any range. Values are rounded to
+* the nearest, ties to even, on every path; int16 saturates at its range and
+* fp16 becomes infinite past 65504. Uses SSE2 and F16C on x86 and NEON on
+* ARM when available, otherwise a scalar loop.
+*/
+void PackInt16(const float * const in, const size_t num, const float scale,
+               int16_t * const out);
+void UnpackInt16(const int16_t * const in, const size_t num, const float scale,
+                 float * const out);
+void PackFp16(const float * const in, const size_t num, uint16_t * const out);
+void UnpackFp16(const uint16_t * const in, const size_t num,
+                float * const out);
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_MPU_BATCH_H_ NOLINT
@@ -0,0 +1,1006 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu_core.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "Wire.h"
+#include "SPI.h"
+#else
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include "core/core.h"
+#endif
+
+namespace bfs {
+
+void MpuCore::Config(TwoWire *i2c, const I2cAddr addr) {
+  imu_.Config(i2c, static_cast<uint8_t>(addr));
+}
+void MpuCore::Config(SPIClass *spi, const uint8_t cs) {
+  imu_.Config(spi, cs);
+}
+#if !defined(INVENSENSE_IMU_NO_INT)
+constexpr MpuCore::Op MpuCore::DRDY_EN_SEQ_[] = {
+  {OP_WRITE_, INT_PIN_CFG_, INT_PULSE_50US_, 0},
+  {OP_WRITE_, INT_ENABLE_, INT_RAW_RDY_EN_, 0},
+  {OP_END_, 0, 0, 0}
+};
+constexpr MpuCore::Op MpuCore::DRDY_DIS_SEQ_[] = {
+  {OP_WRITE_, INT_ENABLE_, INT_DISABLE_, 0},
+  {OP_END_, 0, 0, 0}
+};
+bool MpuCore::EnableDrdyInt() {
+  static_assert(ValidSeq(DRDY_EN_SEQ_), "Invalid sequence");
+  return RunSequence(DRDY_EN_SEQ_);
+}
+bool MpuCore::DisableDrdyInt() {
+  static_assert(ValidSeq(DRDY_DIS_SEQ_), "Invalid sequence");
+  return RunSequence(DRDY_DIS_SEQ_);
+}
+#endif
+bool MpuCore::ConfigAccelRange(const AccelRange range) {
+  if (!StartConfigAccelRange(range)) {
+    return false;
+  }
+  return RunSequence();
+}
+bool MpuCore::ConfigGyroRange(const GyroRange range) {
+  if (!StartConfigGyroRange(range)) {
+    return false;
+  }
+  return RunSequence();
+}
+bool MpuCore::ConfigSrd(const uint8_t srd) {
+  if (!StartConfigSrd(srd)) {
+    return false;
+  }
+  return RunSequence();
+}
+bool MpuCore::ConfigDlpfBandwidth(const DlpfBandwidth dlpf) {
+  if (!StartConfigDlpfBandwidth(dlpf)) {
+    return false;
+  }
+  return RunSequence();
+}
+#if !defined(INVENSENSE_IMU_NO_WOM)
+/*
+* Wake on motion: reset the MPU and run the accel alone at a 184 Hz
+* bandwidth, then set the interrupt, threshold (seq_arg_[1]), and wakeup
+* rate (seq_arg_[0]) and switch to low power mode.
+*/
+constexpr MpuCore::Op MpuCore::WOM_SEQ_[] = {
+  {OP_WRITE_ | OP_IGNORE_FAIL_, PWR_MGMNT_1_, H_RESET_, 0},
+  {OP_WAIT_MS_, 0, 1, 0},
+  {OP_WRITE_, PWR_MGMNT_1_, 0x00, 0},
+  {OP_WRITE_, PWR_MGMNT_2_, DISABLE_GYRO_, 0},
+  {OP_WRITE_, ACCEL_CONFIG2_, DLPF_BANDWIDTH_184HZ, 0},
+  {OP_WRITE_, INT_ENABLE_, INT_WOM_EN_, 0},
+  {OP_WRITE_, MOT_DETECT_CTRL_, ACCEL_INTEL_EN_ | ACCEL_INTEL_MODE_, 0},
+  {OP_WRITE_ | OP_ARG_DATA_, WOM_THR_, 0, 0},
+  {OP_WRITE_ | OP_ARG_DATA0_, LP_ACCEL_ODR_, 0, 0},
+  {OP_WRITE_, PWR_MGMNT_1_, PWR_CYCLE_WOM_, 0},
+  {OP_END_, 0, 0, 0}
+};
+/* The same accel sampling, without the interrupt */
+constexpr MpuCore::Op MpuCore::WOM_CAL_SEQ_[] = {
+  {OP_WRITE_ | OP_IGNORE_FAIL_, PWR_MGMNT_1_, H_RESET_, 0},
+  {OP_WAIT_MS_, 0, 1, 0},
+  {OP_WRITE_, PWR_MGMNT_1_, 0x00, 0},
+  {OP_WRITE_, PWR_MGMNT_2_, DISABLE_GYRO_, 0},
+  {OP_WRITE_, ACCEL_CONFIG2_, DLPF_BANDWIDTH_184HZ, 0},
+  {OP_WRITE_ | OP_ARG_DATA0_, LP_ACCEL_ODR_, 0, 0},
+  {OP_WRITE_, PWR_MGMNT_1_, PWR_CYCLE_WOM_, 0},
+  {OP_END_, 0, 0, 0}
+};
+/*
+* Shock capture: the WOM comparator at the full sample rate, comparing to the
+* previous sample, with the threshold in seq_arg_[1].
+*/
+constexpr MpuCore::Op MpuCore::SHOCK_SEQ_[] = {
+  {OP_WRITE_, MOT_DETECT_CTRL_, ACCEL_INTEL_EN_ | ACCEL_INTEL_MODE_, 0},
+  {OP_WRITE_ | OP_ARG_DATA_, WOM_THR_, 0, 0},
+  {OP_WRITE_, INT_PIN_CFG_, INT_PULSE_50US_, 0},
+  {OP_WRITE_, INT_ENABLE_, INT_WOM_EN_, 0},
+  {OP_END_, 0, 0, 0}
+};
+bool MpuCore::EnableWom(int16_t threshold_mg, const WomRate wom_rate) {
+  static_assert(ValidSeq(WOM_SEQ_), "Invalid sequence");
+  /* Check threshold in limits, 4 - 1020 mg */
+  if ((threshold_mg < 4) || (threshold_mg > 1020)) {return false;}
+  if (busy()) {return false;}
+  /* The LSB is 4 mg */
+  seq_arg_[1] = static_cast<uint8_t>(threshold_mg / static_cast<int8_t>(4));
+  seq_arg_[0] = wom_rate;
+  StartSequence(WOM_SEQ_, nullptr);
+  return RunSequence();
+}
+bool MpuCore::CalibrateWom(const float noise_mult, const WomRate wom_rate,
+                           const uint32_t duration_ms, WomCal * const cal) {
+  if ((!cal) || (noise_mult <= 0.0f)) {return false;}
+  /* Check that the WOM rate is valid */
+  if ((wom_rate < WOM_RATE_0_24HZ) || (wom_rate > WOM_RATE_500HZ)) {
+    return false;
+  }
+  /* WOM rates step by powers of two from 1000 / 4096 Hz */
+  float rate_hz = 1000.0f / static_cast<float>(4096 >> wom_rate);
+  uint32_t period_ms = 4096 >> wom_rate;
+  if (static_cast<float>(duration_ms) * rate_hz / 1000.0f <
+      static_cast<float>(WOM_CAL_MIN_SAMPLES_)) {
+    return false;
+  }
+  /* Sample the accel the same way it is sampled for WOM, without the int */
+  static_assert(ValidSeq(WOM_CAL_SEQ_), "Invalid sequence");
+  if (busy()) {return false;}
+  seq_arg_[0] = wom_rate;
+  StartSequence(WOM_CAL_SEQ_, nullptr);
+  if (!RunSequence()) {
+    return false;
+  }
+  /*
+  * The WOM comparator checks each sample against the previous one, so the
+  * noise is measured on the sample to sample difference of each axis.
+  */
+  uint8_t buf[7];
+  int16_t prev_cnts[3], cnts;
+  float diff_mg, sum_sq = 0.0f;
+  uint32_t num_diffs = 0;
+  bool have_prev = false;
+  cal->num_samples = 0;
+  cal->peak_noise_mg = 0.0f;
+  spi_clock_ = SPI_READ_CLOCK_;
+  uint32_t t_start_ms = millis();
+  uint32_t t_last_sample_ms = t_start_ms;
+  while (millis() - t_start_ms < duration_ms) {
+    if (!ReadRegisters(INT_STATUS_, sizeof(buf), buf)) {
+      return false;
+    }
+    if (!(buf[0] & RAW_DATA_RDY_INT_)) {
+      if (millis() - t_last_sample_ms > 2 * period_ms + 100) {
+        return false;
+      }
+      delay(1);
+      continue;
+    }
+    t_last_sample_ms = millis();
+    for (size_t i = 0; i < 3; i++) {
+      cnts = static_cast<int16_t>(buf[2 * i + 1]) << 8 | buf[2 * i + 2];
+      if (have_prev) {
+        diff_mg = static_cast<float>(cnts - prev_cnts[i]) * WOM_CAL_SCALE_MG_;
+        if (fabsf(diff_mg) > cal->peak_noise_mg) {
+          cal->peak_noise_mg = fabsf(diff_mg);
+        }
+        sum_sq += diff_mg * diff_mg;
+        num_diffs++;
+      }
+      prev_cnts[i] = cnts;
+    }
+    have_prev = true;
+    if (cal->num_samples < 0xFFFF) {
+      cal->num_samples++;
+    }
+  }
+  if (cal->num_samples < WOM_CAL_MIN_SAMPLES_) {
+    return false;
+  }
+  cal->noise_std_mg = sqrtf(sum_sq / static_cast<float>(num_diffs));
+  /* Round the threshold up to the 4 mg LSB and limit to 4 - 1020 mg */
+  float threshold_mg = ceilf(noise_mult * cal->peak_noise_mg / 4.0f) * 4.0f;
+  if (threshold_mg < 4.0f) {
+    threshold_mg = 4.0f;
+  }
+  if (threshold_mg > 1020.0f) {
+    threshold_mg = 1020.0f;
+  }
+  cal->threshold_mg = static_cast<int16_t>(threshold_mg);
+  /*
+  * Expected false wakes, modeling the noise as Gaussian. The probability of
+  * a single axis exceeding the threshold is erfc(thr / (std * sqrt(2))),
+  * computed with the Abramowitz and Stegun 7.1.26 approximation.
+  */
+  if (cal->noise_std_mg > 0.0f) {
+    float x = threshold_mg / (cal->noise_std_mg * 1.41421356f);
+    float t = 1.0f / (1.0f + 0.3275911f * x);
+    float p_axis = t * (0.254829592f + t * (-0.284496736f + t *
+                   (1.421413741f + t * (-1.453152027f + t * 1.061405429f)))) *
+                   expf(-x * x);
+    float p_wake = 1.0f - (1.0f - p_axis) * (1.0f - p_axis) *
+                   (1.0f - p_axis);
+    cal->false_wakes_per_hr = p_wake * rate_hz * 3600.0f;
+  } else {
+    cal->false_wakes_per_hr = 0.0f;
+  }
+  /* Enable WOM with the calibrated threshold */
+  return EnableWom(cal->threshold_mg, wom_rate);
+}
+bool MpuCore::EnableShockCapture(const int16_t threshold_mg) {
+  /* Check threshold in limits, 4 - 1020 mg */
+  if ((threshold_mg < 4) || (threshold_mg > 1020)) {return false;}
+  /* Sample at the maximum rate */
+  if (!ConfigSrd(0)) {
+    return false;
+  }
+  static_assert(ValidSeq(SHOCK_SEQ_), "Invalid sequence");
+  /* The LSB is 4 mg */
+  seq_arg_[1] = static_cast<uint8_t>(threshold_mg / static_cast<int8_t>(4));
+  StartSequence(SHOCK_SEQ_, nullptr);
+  if (!RunSequence()) {
+    return false;
+  }
+  spi_clock_ = SPI_CFG_CLOCK_;
+  if (!StartFifo()) {
+    return false;
+  }
+  shock_poll_ms_ = millis();
+  return true;
+}
+bool MpuCore::ReadShock(const uint8_t post_frames, ShockEvent * const event) {
+  if ((!event) || (post_frames > ShockEvent::MAX_POST_FRAMES)) {return false;}
+  uint8_t status;
+  uint8_t discard[FIFO_FRAME_SIZE_];
+  uint16_t count;
+  spi_clock_ = SPI_READ_CLOCK_;
+  /* Check whether the WOM comparator fired, reading clears the status */
+  if (!ReadRegisters(INT_STATUS_, sizeof(status), &status)) {
+    return false;
+  }
+  /* The event happened after the previous poll found none */
+  const uint32_t t_poll_ms = millis();
+  const uint32_t poll_latency_ms = t_poll_ms - shock_poll_ms_;
+  shock_poll_ms_ = t_poll_ms;
+  if (!(status & WOM_INT_)) {
+    return false;
+  }
+  /* Freeze the FIFO, its contents are the pre-event history */
+  if (!imu_.WriteRegisterNoVerify(FIFO_EN_, FIFO_DISABLE_, SPI_CFG_CLOCK_)) {
+    return false;
+  }
+  event->num_frames = 0;
+  event->accel_scale_mps2 = accel_scale_ * G_MPS2_;
+  event->gyro_scale_radps = gyro_scale_ * DEG2RAD_;
+  /*
+  * Once the FIFO overflows the oldest bytes are overwritten, leaving a
+  * partial frame at the head of the FIFO, which is discarded.
+  */
+  bool pre_status = ReadFifoCount(&count);
+  if ((pre_status) && (count % FIFO_FRAME_SIZE_)) {
+    pre_status = ReadRegisters(FIFO_READ_, count % FIFO_FRAME_SIZE_,
+                               discard);
+  }
+  if (pre_status) {
+    pre_status = ReadShockFrames(count / FIFO_FRAME_SIZE_, event);
+  }
+  event->trigger_frame = event->num_frames;
+  /* Frames are 1 ms apart at the maximum sample rate */
+  event->poll_latency_ms = poll_latency_ms;
+  event->in_history = poll_latency_ms < event->trigger_frame;
+  /* Resume streaming to the FIFO for the post-event window */
+  if (!imu_.WriteRegisterNoVerify(FIFO_EN_, FIFO_TEMP_GYRO_ACCEL_,
+                                  SPI_CFG_CLOCK_)) {
+    return false;
+  }
+  if (!pre_status) {
+    return false;
+  }
+  uint16_t num_frames;
+  uint16_t end_frame = event->trigger_frame + post_frames;
+  const uint8_t max_burst = read_burst_frames();
+  uint32_t t_last_frame_ms = millis();
+  while (event->num_frames < end_frame) {
+    if (!ReadFifoCount(&count)) {
+      return false;
+    }
+    num_frames = count / FIFO_FRAME_SIZE_;
+    const uint16_t remaining = end_frame - event->num_frames;
+    if (num_frames > remaining) {
+      num_frames = remaining;
+    }
+    /*
+    * Read in full bursts, or the rest of the window. Frames arrive every
+    * 1 ms, so sleep until enough have arrived rather than polling the count.
+    */
+    const uint16_t want = (remaining < max_burst) ? remaining : max_burst;
+    if (num_frames < want) {
+      if (millis() - t_last_frame_ms > SHOCK_TIMEOUT_MS_) {
+        return false;
+      }
+      delay(want - num_frames);
+      continue;
+    }
+    if (!ReadShockFrames(num_frames, event)) {
+      return false;
+    }
+    t_last_frame_ms = millis();
+  }
+  return true;
+}
+#endif
+bool MpuCore::EnableFifo() {
+  spi_clock_ = SPI_CFG_CLOCK_;
+  if (!StartFifo()) {
+    return false;
+  }
+  fifo_enabled_ = true;
+  return true;
+}
+bool MpuCore::DisableFifo() {
+  spi_clock_ = SPI_CFG_CLOCK_;
+  fifo_enabled_ = false;
+  ClearDualPath();
+  if (!WriteRegister(FIFO_EN_, FIFO_DISABLE_)) {
+    return false;
+  }
+  uint8_t user_ctrl;
+  if (!ReadRegisters(USER_CTRL_, sizeof(user_ctrl), &user_ctrl)) {
+    return false;
+  }
+  if (!WriteRegister(USER_CTRL_, user_ctrl & ~FIFO_ENABLE_)) {
+    return false;
+  }
+  return true;
+}
+bool MpuCore::ConfigDualPath(const CtrlRead read) {
+  if (!read) {return false;}
+  /* The logging path needs the FIFO */
+  if ((!fifo_enabled_) && (!EnableFifo())) {
+    return false;
+  }
+  ctrl_read_ = read;
+  log_busy_ = false;
+  ctrl_deferred_ = false;
+  num_deferred_ = 0;
+  dual_path_ = true;
+  return true;
+}
+void MpuCore::ClearDualPath() {
+  dual_path_ = false;
+  log_busy_ = false;
+  ctrl_deferred_ = false;
+}
+bool MpuCore::ConfigRawPool(RawBuffer * const bufs, const uint8_t num_bufs) {
+  if ((!bufs) || (num_bufs == 0)) {return false;}
+  for (uint8_t i = 0; i < num_bufs; i++) {
+    if ((!bufs[i].data) || (bufs[i].size == 0)) {return false;}
+    bufs[i].len = 0;
+    bufs[i].state = RAW_FREE_;
+  }
+  raw_bufs_ = bufs;
+  num_raw_bufs_ = num_bufs;
+  raw_fill_idx_ = 0;
+  raw_acquire_idx_ = 0;
+  return true;
+}
+bool MpuCore::DumpRegisters(RegisterDump * const dump) {
+  if (!dump) {return false;}
+  if (busy()) {return false;}
+  spi_clock_ = SPI_CFG_CLOCK_;
+  *dump = {};
+  /*
+  * Three ranges, skipping INT_STATUS and FIFO_R_W, each read in bursts no
+  * longer than the bus allows, i.e. the Wire buffer on I2C
+  */
+  static constexpr uint8_t RANGES[3][2] = {
+    {0x00, INT_STATUS_},
+    {INT_STATUS_ + 1, FIFO_READ_},
+    {FIFO_READ_ + 1, NUM_REGS_}
+  };
+  const uint8_t max_read = imu_.max_read();
+  for (size_t i = 0; i < 3; i++) {
+    for (uint8_t first = RANGES[i][0]; first < RANGES[i][1];) {
+      const uint8_t len = (RANGES[i][1] - first > max_read) ? max_read :
+                          RANGES[i][1] - first;
+      if (!ReadRegisters(first, len, &dump->regs[first])) {
+        return false;
+      }
+      for (uint8_t reg = first; reg < first + len; reg++) {
+        dump->valid[reg / 8] |= (1 << (reg % 8));
+      }
+      first += len;
+    }
+  }
+  return true;
+}
+void MpuCore::ExpectedRegisters(RegisterDump * const expected) const {
+  if (!expected) {return;}
+  *expected = {};
+  /* The settings made by Begin and the Config methods */
+  ExpectRegister(expected, PWR_MGMNT_1_, CLKSEL_PLL_);
+  ExpectRegister(expected, SMPLRT_DIV_, srd_);
+  ExpectRegister(expected, CONFIG_, dlpf_bandwidth_);
+  ExpectRegister(expected, ACCEL_CONFIG2_, dlpf_bandwidth_);
+  ExpectRegister(expected, ACCEL_CONFIG_, accel_range_);
+  ExpectRegister(expected, GYRO_CONFIG_, gyro_range_);
+  if (fifo_enabled_) {
+    ExpectRegister(expected, FIFO_EN_, FIFO_TEMP_GYRO_ACCEL_);
+  }
+}
+size_t MpuCore::DiffRegisters(const RegisterDump &dump,
+                              const RegisterDump &ref,
+                              RegisterDiff * const diffs,
+                              const size_t max_diffs) {
+  size_t num_diffs = 0;
+  for (size_t reg = 0; reg < RegisterDump::NUM_REGS; reg++) {
+    const uint8_t bit = 1 << (reg % 8);
+    if ((!(dump.valid[reg / 8] & bit)) || (!(ref.valid[reg / 8] & bit)) ||
+        (dump.regs[reg] == ref.regs[reg])) {
+      continue;
+    }
+    if ((diffs) && (num_diffs < max_diffs)) {
+      diffs[num_diffs] = {false, static_cast<uint8_t>(reg), dump.regs[reg],
+                          ref.regs[reg]};
+    }
+    num_diffs++;
+  }
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  for (size_t reg = 0; reg < RegisterDump::NUM_MAG_REGS; reg++) {
+    const uint16_t bit = 1 << reg;
+    if ((!(dump.mag_valid & bit)) || (!(ref.mag_valid & bit)) ||
+        (dump.mag_regs[reg] == ref.mag_regs[reg])) {
+      continue;
+    }
+    if ((diffs) && (num_diffs < max_diffs)) {
+      diffs[num_diffs] = {true, static_cast<uint8_t>(reg), dump.mag_regs[reg],
+                          ref.mag_regs[reg]};
+    }
+    num_diffs++;
+  }
+  #endif
+  return num_diffs;
+}
+void MpuCore::ExpectRegister(RegisterDump * const dump, const uint8_t reg,
+                             const uint8_t val) {
+  dump->regs[reg] = val;
+  dump->valid[reg / 8] |= (1 << (reg % 8));
+}
+void MpuCore::Reset() {
+  spi_clock_ = SPI_CFG_CLOCK_;
+  fifo_enabled_ = false;
+  ClearDualPath();
+  /* Abandon any non-blocking operation in progress */
+  seq_ = nullptr;
+  prev_frames_ = 0;
+  tag_frames_ = 0;
+  switch_pending_ = 0;
+  /* Reset the MPU */
+  WriteRegister(PWR_MGMNT_1_, H_RESET_);
+  /* Wait for the MPU to come back up */
+  delay(1);
+}
+bool MpuCore::WriteRegister(const uint8_t reg, const uint8_t data) {
+  return imu_.WriteRegister(reg, data, spi_clock_);
+}
+bool MpuCore::AccelScale(const AccelRange range, float * const scale) {
+  switch (range) {
+    case ACCEL_RANGE_2G: {
+      *scale = 2.0f / 32767.5f;
+      return true;
+    }
+    case ACCEL_RANGE_4G: {
+      *scale = 4.0f / 32767.5f;
+      return true;
+    }
+    case ACCEL_RANGE_8G: {
+      *scale = 8.0f / 32767.5f;
+      return true;
+    }
+    case ACCEL_RANGE_16G: {
+      *scale = 16.0f / 32767.5f;
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+bool MpuCore::GyroScale(const GyroRange range, float * const scale) {
+  switch (range) {
+    case GYRO_RANGE_250DPS: {
+      *scale = 250.0f / 32767.5f;
+      return true;
+    }
+    case GYRO_RANGE_500DPS: {
+      *scale = 500.0f / 32767.5f;
+      return true;
+    }
+    case GYRO_RANGE_1000DPS: {
+      *scale = 1000.0f / 32767.5f;
+      return true;
+    }
+    case GYRO_RANGE_2000DPS: {
+      *scale = 2000.0f / 32767.5f;
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+bool MpuCore::ValidDlpf(const DlpfBandwidth dlpf) {
+  switch (dlpf) {
+    case DLPF_BANDWIDTH_184HZ:
+    case DLPF_BANDWIDTH_92HZ:
+    case DLPF_BANDWIDTH_41HZ:
+    case DLPF_BANDWIDTH_20HZ:
+    case DLPF_BANDWIDTH_10HZ:
+    case DLPF_BANDWIDTH_5HZ: {
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+void MpuCore::CommitAccelRange(const AccelRange range, const float scale) {
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  bool changed = (range != accel_range_);
+  #endif
+  accel_range_ = range;
+  accel_scale_ = scale;
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  if ((changed) && (range_cb_)) {
+    range_cb_(accel_range_, gyro_range_, range_cb_context_);
+  }
+  #endif
+}
+void MpuCore::CommitGyroRange(const GyroRange range, const float scale) {
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  bool changed = (range != gyro_range_);
+  #endif
+  gyro_range_ = range;
+  gyro_scale_ = scale;
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  if ((changed) && (range_cb_)) {
+    range_cb_(accel_range_, gyro_range_, range_cb_context_);
+  }
+  #endif
+}
+bool MpuCore::SwitchConfig(const uint8_t reg, const uint8_t data,
+                           const float accel_scale, const float gyro_scale) {
+  #if defined(INVENSENSE_IMU_LAZY)
+  /* Convert data read before the switch with the previous scales */
+  for (uint8_t ch = 0x01; ch & ALL_DIRTY_; ch <<= 1) {
+    if (dirty_ & ch) {ConvertChannel(ch);}
+  }
+  #endif
+  /*
+  * Frames in the FIFO before the write were produced with the previous
+  * config. The chip switches at its next sample, so frames that arrive
+  * between the two counts may be at either config.
+  */
+  uint16_t count = 0, count_after = 0;
+  if ((fifo_enabled_) && (!ReadFifoCount(&count))) {
+    return false;
+  }
+  if (!imu_.WriteRegisterNoVerify(reg, data, spi_clock_)) {
+    return false;
+  }
+  if ((fifo_enabled_) && (!ReadFifoCount(&count_after))) {
+    return false;
+  }
+  /* Clear data ready, so the next sample read is at the new config */
+  uint8_t int_status;
+  if (!ReadRegisters(INT_STATUS_, sizeof(int_status), &int_status)) {
+    return false;
+  }
+  const uint16_t prev_frames = count / FIFO_FRAME_SIZE_;
+  const uint16_t after_frames = count_after / FIFO_FRAME_SIZE_;
+  prev_frames_ = prev_frames;
+  /* Tag the first frame at the new config and any ambiguous frames */
+  tag_frames_ = (after_frames > prev_frames) ? after_frames - prev_frames : 1;
+  prev_accel_scale_ = accel_scale_;
+  prev_gyro_scale_ = gyro_scale_;
+  accel_scale_ = accel_scale;
+  gyro_scale_ = gyro_scale;
+  switch_pending_ = SWITCH_SNAPSHOT_;
+  #if defined(INVENSENSE_IMU_COMPACT)
+  /* The accessors keep the previous scales until the next sample */
+  switch_pending_ |= SWITCH_COUNTS_;
+  #endif
+  return true;
+}
+void MpuCore::RevertSwitch() {
+  accel_scale_ = prev_accel_scale_;
+  gyro_scale_ = prev_gyro_scale_;
+  prev_frames_ = 0;
+  tag_frames_ = 0;
+  switch_pending_ = 0;
+}
+/*
+* Range and DLPF changes switch the scales and tag the next sample in the
+* same step as the register write, then verify it after the usual 10 ms
+*/
+constexpr MpuCore::Op MpuCore::ACCEL_RANGE_SEQ_[] = {
+  {OP_HOOK_, 0, HOOK_SWITCH_ACCEL_, 0},
+  {OP_WAIT_MS_, 0, 10, 0},
+  {OP_HOOK_, 0, HOOK_ACCEL_RANGE_, 0},
+  {OP_END_, 0, 0, 0}
+};
+constexpr MpuCore::Op MpuCore::GYRO_RANGE_SEQ_[] = {
+  {OP_HOOK_, 0, HOOK_SWITCH_GYRO_, 0},
+  {OP_WAIT_MS_, 0, 10, 0},
+  {OP_HOOK_, 0, HOOK_GYRO_RANGE_, 0},
+  {OP_END_, 0, 0, 0}
+};
+constexpr MpuCore::Op MpuCore::DLPF_SEQ_[] = {
+  {OP_HOOK_, 0, HOOK_SWITCH_DLPF_, 0},
+  {OP_WAIT_MS_, 0, 10, 0},
+  {OP_HOOK_, 0, HOOK_DLPF_, 0},
+  {OP_END_, 0, 0, 0}
+};
+constexpr MpuCore::Op MpuCore::SRD_SEQ_[] = {
+  {OP_WRITE_ | OP_ARG_DATA_, SMPLRT_DIV_, 0, 0},
+  {OP_HOOK_, 0, HOOK_SRD_, 0},
+  {OP_END_, 0, 0, 0}
+};
+void MpuCore::StartSequence(const Op * const seq, const SeqHook hook) {
+  seq_ = seq;
+  seq_hook_ = hook;
+  seq_pc_ = 0;
+  seq_step_ = 0;
+  seq_wait_ms_ = 0;
+  seq_status_ = POLL_BUSY;
+}
+uint32_t MpuCore::seq_wait_remaining_ms() const {
+  uint32_t elapsed_ms = millis() - seq_wait_start_ms_;
+  return (elapsed_ms < seq_wait_ms_) ? seq_wait_ms_ - elapsed_ms : 0;
+}
+bool MpuCore::RunSequence() {
+  PollStatus status;
+  while ((status = Poll()) == POLL_BUSY) {
+    delay(seq_wait_remaining_ms());
+  }
+  return (status == POLL_DONE);
+}
+bool MpuCore::RunSequence(const Op * const seq) {
+  if (busy()) {return false;}
+  StartSequence(seq, nullptr);
+  return RunSequence();
+}
+bool MpuCore::StartConfigAccelRange(const AccelRange range) {
+  static_assert(ValidSeq(ACCEL_RANGE_SEQ_), "Invalid sequence");
+  if (busy()) {return false;}
+  float scale;
+  if (!AccelScale(range, &scale)) {return false;}
+  seq_arg_[1] = range;
+  StartSequence(ACCEL_RANGE_SEQ_, nullptr);
+  return true;
+}
+bool MpuCore::StartConfigGyroRange(const GyroRange range) {
+  static_assert(ValidSeq(GYRO_RANGE_SEQ_), "Invalid sequence");
+  if (busy()) {return false;}
+  float scale;
+  if (!GyroScale(range, &scale)) {return false;}
+  seq_arg_[1] = range;
+  StartSequence(GYRO_RANGE_SEQ_, nullptr);
+  return true;
+}
+bool MpuCore::StartConfigDlpfBandwidth(const DlpfBandwidth dlpf) {
+  static_assert(ValidSeq(DLPF_SEQ_), "Invalid sequence");
+  if (busy()) {return false;}
+  if (!ValidDlpf(dlpf)) {return false;}
+  seq_arg_[1] = dlpf;
+  StartSequence(DLPF_SEQ_, nullptr);
+  return true;
+}
+bool MpuCore::StartConfigSrd(const uint8_t srd) {
+  static_assert(ValidSeq(SRD_SEQ_), "Invalid sequence");
+  if (busy()) {return false;}
+  seq_arg_[1] = srd;
+  StartSequence(SRD_SEQ_, nullptr);
+  return true;
+}
+MpuCore::PollStatus MpuCore::Poll() {
+  /* Nothing in progress, the status of the last operation */
+  if (!seq_) {return seq_status_;}
+  /* Wait out any delay before the next bus transfer */
+  if (seq_wait_ms_) {
+    if (millis() - seq_wait_start_ms_ < seq_wait_ms_) {
+      return POLL_BUSY;
+    }
+    seq_wait_ms_ = 0;
+  }
+  const Op &op = seq_[seq_pc_];
+  uint8_t reg = (op.code & OP_ARG_REG_) ? seq_arg_[0] : op.reg;
+  uint8_t data = (op.code & OP_ARG_DATA_) ? seq_arg_[1] :
+                 (op.code & OP_ARG_DATA0_) ? seq_arg_[0] : op.data;
+  bool done = true;
+  bool status;
+  spi_clock_ = SPI_CFG_CLOCK_;
+  switch (op.code & OP_CODE_MASK_) {
+    case OP_WRITE_: {
+      status = StepVerifiedWrite(reg, data, seq_step_ > 0);
+      done = (seq_step_++ > 0);
+      break;
+    }
+    case OP_WRITE_NOVERIFY_: {
+      status = imu_.WriteRegisterNoVerify(reg, data, spi_clock_);
+      break;
+    }
+    case OP_WAIT_MS_: {
+      seq_wait_start_ms_ = millis();
+      seq_wait_ms_ = data;
+      status = true;
+      break;
+    }
+    case OP_CHECK_: {
+      /* An argument value must match exactly */
+      uint8_t alt = (op.code & OP_ARG_DATA_) ? data : op.alt;
+      uint8_t val;
+      status = ReadRegisters(reg, sizeof(val), &val) &&
+               ((val == data) || (val == alt));
+      break;
+    }
+    #if !defined(INVENSENSE_IMU_NO_MAG)
+    case OP_CHECK_AUX_: {
+      status = (seq_buf_[0] == data) || (seq_buf_[0] == op.alt);
+      break;
+    }
+    case OP_AUX_WRITE_: {
+      status = StepAux(true, reg, data, &done);
+      break;
+    }
+    case OP_AUX_READ_: {
+      status = StepAux(false, reg, data, &done);
+      break;
+    }
+    #endif
+    case OP_HOOK_: {
+      status = RunHook(data);
+      break;
+    }
+    case OP_END_: {
+      seq_ = nullptr;
+      seq_status_ = POLL_DONE;
+      return POLL_DONE;
+    }
+    default: {
+      status = false;
+      break;
+    }
+  }
+  if (!status) {
+    if (!(op.code & OP_IGNORE_FAIL_)) {
+      seq_ = nullptr;
+      seq_status_ = POLL_FAILED;
+      return POLL_FAILED;
+    }
+    /* Failures of this op are expected, skip the rest of it */
+    seq_wait_ms_ = 0;
+    done = true;
+  }
+  if (done) {
+    seq_pc_++;
+    seq_step_ = 0;
+  }
+  return POLL_BUSY;
+}
+bool MpuCore::StepVerifiedWrite(const uint8_t reg, const uint8_t data,
+                                const bool verify) {
+  /* Same as WriteRegister, with its 10 ms delay as a wait */
+  if (!verify) {
+    seq_wait_start_ms_ = millis();
+    seq_wait_ms_ = 10;
+    return imu_.WriteRegisterNoVerify(reg, data, spi_clock_);
+  }
+  uint8_t ret_val;
+  if (!ReadRegisters(reg, sizeof(ret_val), &ret_val)) {
+    return false;
+  }
+  return (ret_val == data);
+}
+#if !defined(INVENSENSE_IMU_NO_MAG)
+bool MpuCore::StepAux(const bool write, const uint8_t reg, const uint8_t data,
+                      bool * const done) {
+  /*
+  * AK8963 access through I2C slave 0. A write sets up slave 0 to write the
+  * register and then reads it back; a read starts at the read back. Each
+  * slave register write takes two steps, the write and the verify.
+  */
+  uint8_t step = seq_step_ + (write ? 0 : 8);
+  uint8_t count = write ? 1 : data;
+  uint8_t slv_reg, slv_data;
+  seq_step_++;
+  *done = false;
+  switch (step / 2) {
+    case 0: {
+      slv_reg = I2C_SLV0_ADDR_;
+      slv_data = AK8963_I2C_ADDR_;
+      break;
+    }
+    case 1: {
+      slv_reg = I2C_SLV0_REG_;
+      slv_data = reg;
+      break;
+    }
+    case 2: {
+      slv_reg = I2C_SLV0_DO_;
+      slv_data = data;
+      break;
+    }
+    case 3: {
+      slv_reg = I2C_SLV0_CTRL_;
+      slv_data = I2C_SLV0_EN_ | 1;
+      break;
+    }
+    case 4: {
+      slv_reg = I2C_SLV0_ADDR_;
+      slv_data = AK8963_I2C_ADDR_ | I2C_READ_FLAG_;
+      break;
+    }
+    case 5: {
+      slv_reg = I2C_SLV0_REG_;
+      slv_data = reg;
+      break;
+    }
+    case 6: {
+      slv_reg = I2C_SLV0_CTRL_;
+      slv_data = I2C_SLV0_EN_ | count;
+      break;
+    }
+    default: {
+      /* Give the I2C master 1 ms for the transfer, then read the result */
+      if (step == 14) {
+        seq_wait_start_ms_ = millis();
+        seq_wait_ms_ = 1;
+        return true;
+      }
+      *done = true;
+      if ((count == 0) || (count > sizeof(seq_buf_))) {return false;}
+      if (!ReadRegisters(EXT_SENS_DATA_00_, count, seq_buf_)) {
+        return false;
+      }
+      return (!write) || (seq_buf_[0] == data);
+    }
+  }
+  return StepVerifiedWrite(slv_reg, slv_data, step & 1);
+}
+#endif
+bool MpuCore::RunHook(const uint8_t id) {
+  float scale;
+  switch (id) {
+    case HOOK_SWITCH_ACCEL_: {
+      AccelRange range = static_cast<AccelRange>(seq_arg_[1]);
+      if (!AccelScale(range, &scale)) {return false;}
+      return SwitchConfig(ACCEL_CONFIG_, range, scale, gyro_scale_);
+    }
+    case HOOK_SWITCH_GYRO_: {
+      GyroRange range = static_cast<GyroRange>(seq_arg_[1]);
+      if (!GyroScale(range, &scale)) {return false;}
+      return SwitchConfig(GYRO_CONFIG_, range, accel_scale_, scale);
+    }
+    case HOOK_SWITCH_DLPF_: {
+      if (!imu_.WriteRegisterNoVerify(ACCEL_CONFIG2_, seq_arg_[1],
+                                      spi_clock_)) {
+        return false;
+      }
+      return SwitchConfig(CONFIG_, seq_arg_[1], accel_scale_, gyro_scale_);
+    }
+    case HOOK_ACCEL_RANGE_: {
+      AccelRange range = static_cast<AccelRange>(seq_arg_[1]);
+      uint8_t val;
+      /* Verify, otherwise go back to the previous scale */
+      if ((!ReadRegisters(ACCEL_CONFIG_, sizeof(val), &val)) ||
+          (val != range)) {
+        RevertSwitch();
+        return false;
+      }
+      CommitAccelRange(range, accel_scale_);
+      return true;
+    }
+    case HOOK_GYRO_RANGE_: {
+      GyroRange range = static_cast<GyroRange>(seq_arg_[1]);
+      uint8_t val;
+      if ((!ReadRegisters(GYRO_CONFIG_, sizeof(val), &val)) ||
+          (val != range)) {
+        RevertSwitch();
+        return false;
+      }
+      CommitGyroRange(range, gyro_scale_);
+      return true;
+    }
+    case HOOK_DLPF_: {
+      uint8_t val[2];
+      /* Verify both filters, otherwise undo the switch */
+      if ((!ReadRegisters(ACCEL_CONFIG2_, sizeof(val[0]), &val[0])) ||
+          (!ReadRegisters(CONFIG_, sizeof(val[1]), &val[1])) ||
+          (val[0] != seq_arg_[1]) || (val[1] != seq_arg_[1])) {
+        RevertSwitch();
+        return false;
+      }
+      dlpf_bandwidth_ = static_cast<DlpfBandwidth>(seq_arg_[1]);
+      return true;
+    }
+    case HOOK_SRD_: {
+      srd_ = seq_arg_[1];
+      return true;
+    }
+    case HOOK_DEFAULTS_: {
+      /* The defaults written by Begin */
+      AccelScale(ACCEL_RANGE_16G, &scale);
+      CommitAccelRange(ACCEL_RANGE_16G, scale);
+      GyroScale(GYRO_RANGE_2000DPS, &scale);
+      CommitGyroRange(GYRO_RANGE_2000DPS, scale);
+      dlpf_bandwidth_ = DLPF_BANDWIDTH_184HZ;
+      srd_ = 0;
+      return true;
+    }
+    default: {
+      return (seq_hook_) && (seq_hook_(this, id));
+    }
+  }
+}
+bool MpuCore::StartFifo() {
+  /* Keep the other USER_CTRL settings, such as the I2C master */
+  uint8_t user_ctrl;
+  if (!ReadRegisters(USER_CTRL_, sizeof(user_ctrl), &user_ctrl)) {
+    return false;
+  }
+  /* Reset the FIFO, this bit self clears so the write is not verified */
+  WriteRegister(USER_CTRL_, user_ctrl | FIFO_RESET_);
+  /* Stream accel, temperature, and gyro data to the FIFO */
+  if (!WriteRegister(FIFO_EN_, FIFO_TEMP_GYRO_ACCEL_)) {
+    return false;
+  }
+  if (!WriteRegister(USER_CTRL_, user_ctrl | FIFO_ENABLE_)) {
+    return false;
+  }
+  return true;
+}
+#if !defined(INVENSENSE_IMU_NO_WOM)
+bool MpuCore::ReadShockFrames(const uint16_t num_frames,
+                              ShockEvent * const event) {
+  uint8_t frames[READ_BURST_FRAMES_ * FIFO_FRAME_SIZE_];
+  const uint8_t max_burst = read_burst_frames();
+  for (uint16_t i = 0; i < num_frames;) {
+    const uint8_t burst = (num_frames - i > max_burst) ? max_burst :
+                          static_cast<uint8_t>(num_frames - i);
+    if (!ReadRegisters(FIFO_READ_, burst * FIFO_FRAME_SIZE_, frames)) {
+      return false;
+    }
+    for (uint8_t j = 0; j < burst; j++, i++) {
+      /* Drain, but do not store, frames beyond the record length */
+      if (event->num_frames == ShockEvent::MAX_PRE_FRAMES +
+                               ShockEvent::MAX_POST_FRAMES) {
+        continue;
+      }
+      const uint8_t * const frame = &frames[j * FIFO_FRAME_SIZE_];
+      int16_t *accel = event->accel_cnts[event->num_frames];
+      int16_t *gyro = event->gyro_cnts[event->num_frames];
+      accel[0] = static_cast<int16_t>(frame[0])  << 8 | frame[1];
+      accel[1] = static_cast<int16_t>(frame[2])  << 8 | frame[3];
+      accel[2] = static_cast<int16_t>(frame[4])  << 8 | frame[5];
+      gyro[0] =  static_cast<int16_t>(frame[8])  << 8 | frame[9];
+      gyro[1] =  static_cast<int16_t>(frame[10]) << 8 | frame[11];
+      gyro[2] =  static_cast<int16_t>(frame[12]) << 8 | frame[13];
+      event->num_frames++;
+    }
+  }
+  return true;
+}
+#endif
+
+}  // namespace bfs
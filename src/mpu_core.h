@@ -0,0 +1,724 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_MPU_CORE_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_MPU_CORE_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "Wire.h"
+#include "SPI.h"
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+#include "invensense_imu.h"  // NOLINT
+#if defined(INVENSENSE_IMU_FAULT_INJECTION)
+#include "fault_injector.h"  // NOLINT
+#endif
+
+#if defined(INVENSENSE_IMU_COMPACT) && defined(INVENSENSE_IMU_LAZY)
+#error "INVENSENSE_IMU_COMPACT and INVENSENSE_IMU_LAZY are exclusive"
+#endif
+
+namespace bfs {
+
+/*
+* Functionality shared by the MPU-6500 and the MPU-9250, which packages an
+* MPU-6500 with an AK8963. This is a plain base class, rather than a
+* template, so the shared code is only linked in once when both sensors
+* are used.
+*/
+class MpuCore {
+ public:
+  friend class MpuAsync;
+  friend class MpuTiming;
+  /* Sensor and filter settings */
+  enum I2cAddr : uint8_t {
+    I2C_ADDR_PRIM = 0x68,
+    I2C_ADDR_SEC = 0x69
+  };
+  enum DlpfBandwidth : int8_t {
+    DLPF_BANDWIDTH_184HZ = 0x01,
+    DLPF_BANDWIDTH_92HZ = 0x02,
+    DLPF_BANDWIDTH_41HZ = 0x03,
+    DLPF_BANDWIDTH_20HZ = 0x04,
+    DLPF_BANDWIDTH_10HZ = 0x05,
+    DLPF_BANDWIDTH_5HZ = 0x06
+  };
+  enum AccelRange : int8_t {
+    ACCEL_RANGE_2G = 0x00,
+    ACCEL_RANGE_4G = 0x08,
+    ACCEL_RANGE_8G = 0x10,
+    ACCEL_RANGE_16G = 0x18
+  };
+  enum GyroRange : int8_t {
+    GYRO_RANGE_250DPS = 0x00,
+    GYRO_RANGE_500DPS = 0x08,
+    GYRO_RANGE_1000DPS = 0x10,
+    GYRO_RANGE_2000DPS = 0x18
+  };
+  enum WomRate : int8_t {
+    WOM_RATE_0_24HZ = 0x00,
+    WOM_RATE_0_49HZ = 0x01,
+    WOM_RATE_0_98HZ = 0x02,
+    WOM_RATE_1_95HZ = 0x03,
+    WOM_RATE_3_91HZ = 0x04,
+    WOM_RATE_7_81HZ = 0x05,
+    WOM_RATE_15_63HZ = 0x06,
+    WOM_RATE_31_25HZ = 0x07,
+    WOM_RATE_62_50HZ = 0x08,
+    WOM_RATE_125HZ = 0x09,
+    WOM_RATE_250HZ = 0x0A,
+    WOM_RATE_500HZ = 0x0B
+  };
+  #if !defined(INVENSENSE_IMU_NO_WOM)
+  /* Wake on motion noise floor calibration results */
+  struct WomCal {
+    int16_t threshold_mg;
+    uint16_t num_samples;
+    float peak_noise_mg;
+    float noise_std_mg;
+    float false_wakes_per_hr;
+  };
+  /*
+  * Shock event record. Frames are raw accel and gyro counts in the sensor
+  * frame, oldest first; frames before trigger_frame are the pre-event history
+  * frozen in the FIFO, the remainder are the post-event window. The
+  * trigger_frame is where ReadShock found the event, not where WOM fired;
+  * the event is at most poll_latency_ms earlier, the time since the previous
+  * poll, and in_history is true when the 1 kHz history reaches back that far.
+  */
+  struct ShockEvent {
+    /* The 512 byte FIFO holds 36 frames of accel, temp, and gyro data */
+    static constexpr size_t MAX_PRE_FRAMES = 36;
+    static constexpr size_t MAX_POST_FRAMES = 36;
+    uint8_t trigger_frame;
+    uint8_t num_frames;
+    uint32_t poll_latency_ms;
+    bool in_history;
+    float accel_scale_mps2;
+    float gyro_scale_radps;
+    int16_t accel_cnts[MAX_PRE_FRAMES + MAX_POST_FRAMES][3];
+    int16_t gyro_cnts[MAX_PRE_FRAMES + MAX_POST_FRAMES][3];
+  };
+  #endif
+  /* One sample, as returned by the batch Read */
+  struct Sample {
+    float accel_x_mps2;
+    float accel_y_mps2;
+    float accel_z_mps2;
+    float gyro_x_radps;
+    float gyro_y_radps;
+    float gyro_z_radps;
+    float die_temp_c;
+    /* First sample produced after a range or DLPF change */
+    bool config_changed;
+  };
+  /*
+  * User owned buffer for zero-copy raw reads. The driver fills data, up to
+  * size bytes, directly from the bus and sets len; fifo_frames indicates
+  * whether data holds 14 byte FIFO frames or a register snapshot starting
+  * from INT_STATUS. state is managed by the driver.
+  */
+  struct RawBuffer {
+    uint8_t *data;
+    uint16_t size;
+    uint16_t len;
+    bool fifo_frames;
+    volatile uint8_t state;
+  };
+  /*
+  * Register snapshot for diagnostics, valid has a bit set for each register
+  * read or, in an expected snapshot, each register with a known value.
+  * INT_STATUS and FIFO_R_W are not read, since reading clears the status
+  * and removes data from the FIFO.
+  */
+  struct RegisterDump {
+    static constexpr size_t NUM_REGS = 128;
+    uint8_t regs[NUM_REGS];
+    uint8_t valid[NUM_REGS / 8];
+    #if !defined(INVENSENSE_IMU_NO_MAG)
+    /* AK8963 WIA through ASTC, MPU-9250 only */
+    static constexpr size_t NUM_MAG_REGS = 13;
+    uint8_t mag_regs[NUM_MAG_REGS];
+    uint16_t mag_valid;
+    #endif
+  };
+  /* A register that differs between two snapshots */
+  struct RegisterDiff {
+    bool mag;
+    uint8_t reg;
+    uint8_t value;
+    uint8_t expected;
+  };
+  /* Status of a non-blocking operation */
+  enum PollStatus : int8_t {
+    POLL_FAILED = -1,
+    POLL_DONE = 0,
+    POLL_BUSY = 1
+  };
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  /* Event callbacks, a plain function taking a user context pointer */
+  using ImuCallback = void (*)(const Sample &sample, void *context);
+  using RangeCallback = void (*)(const AccelRange accel_range,
+                                 const GyroRange gyro_range, void *context);
+  using CtrlCallback = void (*)(void *context);
+  #endif
+  void Config(TwoWire *i2c, const I2cAddr addr);
+  void Config(SPIClass *spi, const uint8_t cs);
+  #if !defined(INVENSENSE_IMU_NO_INT)
+  bool EnableDrdyInt();
+  bool DisableDrdyInt();
+  #endif
+  bool ConfigAccelRange(const AccelRange range);
+  inline AccelRange accel_range() const {return accel_range_;}
+  bool ConfigGyroRange(const GyroRange range);
+  inline GyroRange gyro_range() const {return gyro_range_;}
+  bool ConfigSrd(const uint8_t srd);
+  inline uint8_t srd() const {return srd_;}
+  bool ConfigDlpfBandwidth(const DlpfBandwidth dlpf);
+  inline DlpfBandwidth dlpf_bandwidth() const {return dlpf_bandwidth_;}
+  /* Non-blocking configuration, advanced by calling Poll */
+  bool StartConfigAccelRange(const AccelRange range);
+  bool StartConfigGyroRange(const GyroRange range);
+  bool StartConfigDlpfBandwidth(const DlpfBandwidth dlpf);
+  bool StartConfigSrd(const uint8_t srd);
+  PollStatus Poll();
+  inline bool busy() const {return seq_ != nullptr;}
+  #if !defined(INVENSENSE_IMU_NO_WOM)
+  bool EnableWom(int16_t threshold_mg, const WomRate wom_rate);
+  bool CalibrateWom(const float noise_mult, const WomRate wom_rate,
+                    const uint32_t duration_ms, WomCal * const cal);
+  bool EnableShockCapture(const int16_t threshold_mg);
+  bool ReadShock(const uint8_t post_frames, ShockEvent * const event);
+  #endif
+  bool EnableFifo();
+  bool DisableFifo();
+  /*
+  * Dual path mode, enabled by the derived class. Read takes the latest
+  * sample from the data registers for control, while the batch Read or
+  * ReadRaw drains every sample from the FIFO for logging.
+  */
+  inline void DisableDualPath() {ClearDualPath();}
+  inline bool dual_path() const {return dual_path_;}
+  inline uint32_t num_deferred() const {return num_deferred_;}
+  INVENSENSE_IMU_ISR_SAFE
+  size_t Read(Sample * const samples, const size_t max_samples);
+  bool ConfigRawPool(RawBuffer * const bufs, const uint8_t num_bufs);
+  bool DumpRegisters(RegisterDump * const dump);
+  void ExpectedRegisters(RegisterDump * const expected) const;
+  static size_t DiffRegisters(const RegisterDump &dump,
+                              const RegisterDump &ref,
+                              RegisterDiff * const diffs,
+                              const size_t max_diffs);
+  INVENSENSE_IMU_ISR_SAFE RawBuffer *AcquireRaw();
+  INVENSENSE_IMU_ISR_SAFE void ReleaseRaw(RawBuffer * const buf);
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  inline void OnNewImuData(ImuCallback cb, void * const context) {
+    imu_cb_ = cb;
+    imu_cb_context_ = context;
+  }
+  /* Binds a member function, resolved at compile time */
+  template<class T, void (T::*Method)(const Sample &)>
+  inline void OnNewImuData(T * const obj) {
+    OnNewImuData([](const Sample &sample, void *context) {
+      (static_cast<T *>(context)->*Method)(sample);
+    }, obj);
+  }
+  inline void OnRangeChange(RangeCallback cb, void * const context) {
+    range_cb_ = cb;
+    range_cb_context_ = context;
+  }
+  template<class T, void (T::*Method)(const AccelRange, const GyroRange)>
+  inline void OnRangeChange(T * const obj) {
+    OnRangeChange([](const AccelRange accel_range, const GyroRange gyro_range,
+                     void *context) {
+      (static_cast<T *>(context)->*Method)(accel_range, gyro_range);
+    }, obj);
+  }
+  /*
+  * Control path sample in dual path mode, called once Read has updated the
+  * data methods, including for a read deferred to the logging path
+  */
+  inline void OnControlData(CtrlCallback cb, void * const context) {
+    ctrl_cb_ = cb;
+    ctrl_cb_context_ = context;
+  }
+  template<class T, void (T::*Method)()>
+  inline void OnControlData(T * const obj) {
+    OnControlData([](void *context) {
+      (static_cast<T *>(context)->*Method)();
+    }, obj);
+  }
+  #endif
+  void Reset();
+  inline bool new_imu_data() const {return new_imu_data_;}
+  inline bool config_changed() const {return config_changed_;}
+  #if defined(INVENSENSE_IMU_COMPACT)
+  /*
+  * Compact layout, engineering units are computed from the counts, with the
+  * previous scales until a sample at a new range has been read
+  */
+  inline float accel_x_mps2() const {
+    return static_cast<float>(accel_cnts_[1]) * snap_accel_scale() * G_MPS2_;
+  }
+  inline float accel_y_mps2() const {
+    return static_cast<float>(accel_cnts_[0]) * snap_accel_scale() * G_MPS2_;
+  }
+  inline float accel_z_mps2() const {
+    return static_cast<float>(accel_cnts_[2]) * snap_accel_scale() * -1.0f *
+           G_MPS2_;
+  }
+  inline float gyro_x_radps() const {
+    return static_cast<float>(gyro_cnts_[1]) * snap_gyro_scale() * DEG2RAD_;
+  }
+  inline float gyro_y_radps() const {
+    return static_cast<float>(gyro_cnts_[0]) * snap_gyro_scale() * DEG2RAD_;
+  }
+  inline float gyro_z_radps() const {
+    return static_cast<float>(gyro_cnts_[2]) * snap_gyro_scale() * -1.0f *
+           DEG2RAD_;
+  }
+  inline float die_temp_c() const {
+    return (static_cast<float>(temp_cnts_) - 21.0f) / TEMP_SCALE_ + 21.0f;
+  }
+  #elif defined(INVENSENSE_IMU_LAZY)
+  /* Lazy conversion, each channel is converted once on first access */
+  inline float accel_x_mps2() const {
+    if (dirty_ & ACCEL_X_DIRTY_) {ConvertChannel(ACCEL_X_DIRTY_);}
+    return accel_[0];
+  }
+  inline float accel_y_mps2() const {
+    if (dirty_ & ACCEL_Y_DIRTY_) {ConvertChannel(ACCEL_Y_DIRTY_);}
+    return accel_[1];
+  }
+  inline float accel_z_mps2() const {
+    if (dirty_ & ACCEL_Z_DIRTY_) {ConvertChannel(ACCEL_Z_DIRTY_);}
+    return accel_[2];
+  }
+  inline float gyro_x_radps() const {
+    if (dirty_ & GYRO_X_DIRTY_) {ConvertChannel(GYRO_X_DIRTY_);}
+    return gyro_[0];
+  }
+  inline float gyro_y_radps() const {
+    if (dirty_ & GYRO_Y_DIRTY_) {ConvertChannel(GYRO_Y_DIRTY_);}
+    return gyro_[1];
+  }
+  inline float gyro_z_radps() const {
+    if (dirty_ & GYRO_Z_DIRTY_) {ConvertChannel(GYRO_Z_DIRTY_);}
+    return gyro_[2];
+  }
+  inline float die_temp_c() const {
+    if (dirty_ & TEMP_DIRTY_) {ConvertChannel(TEMP_DIRTY_);}
+    return temp_;
+  }
+  #else
+  inline float accel_x_mps2() const {return accel_[0];}
+  inline float accel_y_mps2() const {return accel_[1];}
+  inline float accel_z_mps2() const {return accel_[2];}
+  inline float gyro_x_radps() const {return gyro_[0];}
+  inline float gyro_y_radps() const {return gyro_[1];}
+  inline float gyro_z_radps() const {return gyro_[2];}
+  inline float die_temp_c() const {return temp_;}
+  #endif
+  /* Per count scales, for converting raw FIFO frames */
+  inline float accel_scale_mps2() const {return accel_scale_ * G_MPS2_;}
+  inline float gyro_scale_radps() const {return gyro_scale_ * DEG2RAD_;}
+  #if defined(INVENSENSE_IMU_FAULT_INJECTION)
+  /* Injects bus faults into the following transfers, nullptr to stop */
+  inline void ConfigFaults(FaultInjector * const faults) {
+    imu_.ConfigFaults(faults);
+  }
+  #endif
+
+ protected:
+  MpuCore() {}
+  MpuCore(TwoWire *i2c, const I2cAddr addr) :
+          imu_(i2c, static_cast<uint8_t>(addr)) {}
+  MpuCore(SPIClass *spi, const uint8_t cs) :
+          imu_(spi, cs) {}
+  InvensenseImu imu_;
+  int32_t spi_clock_;
+  /*
+  * MPU-6500 supports an SPI clock of 1 MHz for config and 20 MHz for reading
+  * data; however, in testing we found that 20 MHz was sometimes too fast and
+  * scaled this down to 15 MHz, which consistently worked well.
+  */
+  static constexpr int32_t SPI_CFG_CLOCK_ = 1000000;
+  static constexpr int32_t SPI_READ_CLOCK_ = 15000000;
+  /*
+  * Configuration, the ranges start at the sensor's reset values so the
+  * range change callback fires deterministically when Begin sets them
+  */
+  AccelRange accel_range_ = ACCEL_RANGE_2G;
+  GyroRange gyro_range_ = GYRO_RANGE_250DPS;
+  DlpfBandwidth dlpf_bandwidth_;
+  float accel_scale_;
+  float gyro_scale_;
+  uint8_t srd_;
+  /*
+  * Mid-stream reconfiguration, the first prev_frames_ FIFO frames were
+  * produced with the previous scales and the next tag_frames_ frames are
+  * tagged: the first frame at the new config and any frame that arrived
+  * while the config was written, which may be at either config.
+  */
+  float prev_accel_scale_;
+  float prev_gyro_scale_;
+  uint16_t prev_frames_ = 0;
+  uint16_t tag_frames_ = 0;
+  uint8_t switch_pending_ = 0;
+  bool config_changed_ = false;
+  static constexpr uint8_t SWITCH_SNAPSHOT_ = 0x01;
+  /* The counts held for the accessors predate the switch */
+  static constexpr uint8_t SWITCH_COUNTS_ = 0x02;
+  #if defined(INVENSENSE_IMU_COMPACT)
+  inline float snap_accel_scale() const {
+    return (switch_pending_ & SWITCH_COUNTS_) ? prev_accel_scale_ :
+           accel_scale_;
+  }
+  inline float snap_gyro_scale() const {
+    return (switch_pending_ & SWITCH_COUNTS_) ? prev_gyro_scale_ :
+           gyro_scale_;
+  }
+  #endif
+  bool fifo_enabled_ = false;
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  /* Event callbacks */
+  ImuCallback imu_cb_ = nullptr;
+  void *imu_cb_context_ = nullptr;
+  RangeCallback range_cb_ = nullptr;
+  void *range_cb_context_ = nullptr;
+  CtrlCallback ctrl_cb_ = nullptr;
+  void *ctrl_cb_context_ = nullptr;
+  #endif
+  /*
+  * Dual path mode. The logging path marks the bus busy around each of its
+  * FIFO transfers. A control read that preempts it in the middle of one,
+  * from an interrupt or a higher priority task on the same core, is
+  * deferred and run by the logging path as soon as the transfer is done.
+  */
+  using CtrlRead = bool (*)(MpuCore * const core);
+  bool dual_path_ = false;
+  CtrlRead ctrl_read_ = nullptr;
+  volatile bool log_busy_ = false;
+  volatile bool ctrl_deferred_ = false;
+  volatile uint32_t num_deferred_ = 0;
+  /* Raw buffer pool, filled and acquired in ring order */
+  RawBuffer *raw_bufs_ = nullptr;
+  uint8_t num_raw_bufs_ = 0;
+  uint8_t raw_fill_idx_ = 0;
+  uint8_t raw_acquire_idx_ = 0;
+  static constexpr uint8_t RAW_FREE_ = 0;
+  static constexpr uint8_t RAW_FILLED_ = 1;
+  static constexpr uint8_t RAW_ACQUIRED_ = 2;
+  /*
+  * Non-blocking sequence engine. Register operations are listed in tables
+  * and run one bus transfer per step, with the delays between them turned
+  * into waits, so a scheduler can run other work in the meantime.
+  */
+  struct Op {
+    uint8_t code;
+    uint8_t reg;
+    uint8_t data;
+    uint8_t alt;
+  };
+  using SeqHook = bool (*)(MpuCore * const core, const uint8_t id);
+  /* Write data to reg, wait 10 ms, and verify */
+  static constexpr uint8_t OP_WRITE_ = 0x01;
+  /* Write data to reg without verifying, i.e. self clearing bits */
+  static constexpr uint8_t OP_WRITE_NOVERIFY_ = 0x02;
+  /* Wait data ms */
+  static constexpr uint8_t OP_WAIT_MS_ = 0x03;
+  /* Read reg, which must equal data or alt */
+  static constexpr uint8_t OP_CHECK_ = 0x04;
+  /* The first byte of the last AK8963 read must equal data or alt */
+  static constexpr uint8_t OP_CHECK_AUX_ = 0x05;
+  /* Write data to AK8963 reg and verify */
+  static constexpr uint8_t OP_AUX_WRITE_ = 0x06;
+  /* Read data bytes from AK8963 reg into seq_buf_ */
+  static constexpr uint8_t OP_AUX_READ_ = 0x07;
+  /* Call hook data */
+  static constexpr uint8_t OP_HOOK_ = 0x08;
+  static constexpr uint8_t OP_END_ = 0x0F;
+  static constexpr uint8_t OP_CODE_MASK_ = 0x0F;
+  /*
+  * Flags, take reg or data from seq_arg_, or continue on failure. Data is
+  * taken from seq_arg_[0] by tables that need two data arguments and do not
+  * use OP_ARG_REG_.
+  */
+  static constexpr uint8_t OP_ARG_DATA0_ = 0x10;
+  static constexpr uint8_t OP_ARG_REG_ = 0x20;
+  static constexpr uint8_t OP_ARG_DATA_ = 0x40;
+  static constexpr uint8_t OP_IGNORE_FAIL_ = 0x80;
+  /* Hooks handled by the core, derived class hooks start at HOOK_DERIVED_ */
+  static constexpr uint8_t HOOK_ACCEL_RANGE_ = 0x00;
+  static constexpr uint8_t HOOK_GYRO_RANGE_ = 0x01;
+  static constexpr uint8_t HOOK_DLPF_ = 0x02;
+  static constexpr uint8_t HOOK_SRD_ = 0x03;
+  static constexpr uint8_t HOOK_DEFAULTS_ = 0x04;
+  static constexpr uint8_t HOOK_SWITCH_ACCEL_ = 0x05;
+  static constexpr uint8_t HOOK_SWITCH_GYRO_ = 0x06;
+  static constexpr uint8_t HOOK_SWITCH_DLPF_ = 0x07;
+  static constexpr uint8_t HOOK_DERIVED_ = 0x10;
+  static const Op ACCEL_RANGE_SEQ_[];
+  static const Op GYRO_RANGE_SEQ_[];
+  static const Op DLPF_SEQ_[];
+  static const Op SRD_SEQ_[];
+  #if !defined(INVENSENSE_IMU_NO_INT)
+  static const Op DRDY_EN_SEQ_[];
+  static const Op DRDY_DIS_SEQ_[];
+  #endif
+  #if !defined(INVENSENSE_IMU_NO_WOM)
+  static const Op WOM_SEQ_[];
+  static const Op WOM_CAL_SEQ_[];
+  static const Op SHOCK_SEQ_[];
+  #endif
+  /* Longest table, limited by the 8 bit seq_pc_ */
+  static constexpr size_t MAX_SEQ_LEN_ = 255;
+  /* INT_STATUS through EXT_SENS_DATA_23 and the FIFO count are read only */
+  static constexpr uint8_t EXT_SENS_DATA_23_ = 0x60;
+  static constexpr uint8_t FIFO_COUNT_L_ = 0x73;
+  /* Register addresses are 7 bits */
+  static constexpr uint8_t NUM_REGS_ = 0x80;
+  /*
+  * Checks a table when compiling: each table is defined constexpr and
+  * checked with static_assert where it is started. Written as single return
+  * statements, recursing over the table, for C++11 constexpr, which the
+  * Arduino AVR core compiles with.
+  */
+  static constexpr bool ValidSeq(const Op * const seq) {
+    return ValidSeqFrom(seq, 0, 0);
+  }
+  static constexpr bool ValidSeqFrom(const Op * const seq, const size_t pc,
+                                     const uint8_t flags) {
+    return (pc < MAX_SEQ_LEN_) && ValidOp(seq[pc]) &&
+           /* Reg and data0 arguments both use seq_arg_[0] */
+           (((flags | seq[pc].code) & (OP_ARG_REG_ | OP_ARG_DATA0_)) !=
+            (OP_ARG_REG_ | OP_ARG_DATA0_)) &&
+           (((seq[pc].code & OP_CODE_MASK_) == OP_END_) ||
+            ValidSeqFrom(seq, pc + 1, flags | seq[pc].code));
+  }
+  static constexpr bool ValidOp(const Op &op) {
+    return !((op.code & OP_ARG_DATA_) && (op.code & OP_ARG_DATA0_)) &&
+           ValidOpArgs(op, op.code & OP_CODE_MASK_, op.code & OP_ARG_REG_,
+                       op.code & (OP_ARG_DATA_ | OP_ARG_DATA0_));
+  }
+  static constexpr bool ValidOpArgs(const Op &op, const uint8_t code,
+                                    const bool arg_reg, const bool arg_data) {
+    return ((code == OP_WRITE_) || (code == OP_WRITE_NOVERIFY_)) ?
+             (!arg_reg) && Writable(op.reg) :
+           (code == OP_WAIT_MS_) ?
+             (!arg_reg) && (!arg_data) && (op.data > 0) :
+           (code == OP_CHECK_) ?
+             (!arg_reg) && (op.reg <= WHOAMI_) :
+           (code == OP_HOOK_) ?
+             (!arg_reg) && (!arg_data) &&
+             ((op.data <= HOOK_SWITCH_DLPF_) || (op.data >= HOOK_DERIVED_)) :
+           (code == OP_END_) ?
+             (!arg_reg) && (!arg_data) :
+           ValidAuxOp(op, code, arg_reg, arg_data);
+  }
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  static constexpr bool ValidAuxOp(const Op &op, const uint8_t code,
+                                   const bool arg_reg, const bool arg_data) {
+    return (code == OP_CHECK_AUX_) ? (!arg_reg) && (!arg_data) :
+           (code == OP_AUX_WRITE_) ? true :
+           /* The count must fit seq_buf_ */
+           (code == OP_AUX_READ_) ?
+             arg_data || ((op.data > 0) && (op.data <= SEQ_BUF_SIZE_)) :
+           false;
+  }
+  #else
+  static constexpr bool ValidAuxOp(const Op &, const uint8_t, const bool,
+                                   const bool) {
+    return false;
+  }
+  #endif
+  static constexpr bool Writable(const uint8_t reg) {
+    return (reg < NUM_REGS_) && (reg != WHOAMI_) &&
+           ((reg < INT_STATUS_) || (reg > EXT_SENS_DATA_23_)) &&
+           (reg != FIFO_COUNT_) && (reg != FIFO_COUNT_L_) &&
+           (reg != FIFO_READ_);
+  }
+  const Op *seq_ = nullptr;
+  SeqHook seq_hook_ = nullptr;
+  uint8_t seq_pc_;
+  uint8_t seq_step_;
+  uint8_t seq_arg_[2];
+  static constexpr uint8_t SEQ_BUF_SIZE_ = 8;
+  uint8_t seq_buf_[SEQ_BUF_SIZE_];
+  uint16_t seq_wait_ms_ = 0;
+  uint32_t seq_wait_start_ms_;
+  PollStatus seq_status_ = POLL_FAILED;
+  static constexpr float TEMP_SCALE_ = 333.87f;
+  /* Data */
+  static constexpr float G_MPS2_ = 9.80665f;
+  static constexpr float DEG2RAD_ = 3.14159265358979323846264338327950288f /
+                                    180.0f;
+  bool new_imu_data_;
+  int16_t accel_cnts_[3], gyro_cnts_[3], temp_cnts_;
+  #if defined(INVENSENSE_IMU_LAZY)
+  /* Converted values, valid once their dirty bit is cleared */
+  mutable uint8_t dirty_;
+  mutable float accel_[3], gyro_[3];
+  mutable float temp_;
+  static constexpr uint8_t ACCEL_X_DIRTY_ = 0x01;
+  static constexpr uint8_t ACCEL_Y_DIRTY_ = 0x02;
+  static constexpr uint8_t ACCEL_Z_DIRTY_ = 0x04;
+  static constexpr uint8_t GYRO_X_DIRTY_ = 0x08;
+  static constexpr uint8_t GYRO_Y_DIRTY_ = 0x10;
+  static constexpr uint8_t GYRO_Z_DIRTY_ = 0x20;
+  static constexpr uint8_t TEMP_DIRTY_ = 0x40;
+  static constexpr uint8_t ALL_DIRTY_ = 0x7F;
+  #elif !defined(INVENSENSE_IMU_COMPACT)
+  float accel_[3], gyro_[3];
+  float temp_;
+  #endif
+  /* Registers */
+  static constexpr uint8_t PWR_MGMNT_1_ = 0x6B;
+  static constexpr uint8_t H_RESET_ = 0x80;
+  static constexpr uint8_t CLKSEL_PLL_ = 0x01;
+  static constexpr uint8_t WHOAMI_ = 0x75;
+  static constexpr uint8_t ACCEL_CONFIG_ = 0x1C;
+  static constexpr uint8_t GYRO_CONFIG_ = 0x1B;
+  static constexpr uint8_t ACCEL_CONFIG2_ = 0x1D;
+  static constexpr uint8_t CONFIG_ = 0x1A;
+  static constexpr uint8_t SMPLRT_DIV_ = 0x19;
+  static constexpr uint8_t INT_PIN_CFG_ = 0x37;
+  static constexpr uint8_t INT_ENABLE_ = 0x38;
+  static constexpr uint8_t INT_DISABLE_ = 0x00;
+  static constexpr uint8_t INT_PULSE_50US_ = 0x00;
+  static constexpr uint8_t INT_RAW_RDY_EN_ = 0x01;
+  static constexpr uint8_t INT_STATUS_ = 0x3A;
+  static constexpr uint8_t RAW_DATA_RDY_INT_ = 0x01;
+  static constexpr uint8_t USER_CTRL_ = 0x6A;
+  /* Needed for WOM */
+  static constexpr uint8_t INT_WOM_EN_ = 0x40;
+  static constexpr uint8_t PWR_MGMNT_2_ = 0x6C;
+  static constexpr uint8_t DISABLE_GYRO_ = 0x07;
+  static constexpr uint8_t MOT_DETECT_CTRL_ = 0x69;
+  static constexpr uint8_t ACCEL_INTEL_EN_ = 0x80;
+  static constexpr uint8_t ACCEL_INTEL_MODE_ = 0x40;
+  static constexpr uint8_t LP_ACCEL_ODR_ = 0x1E;
+  static constexpr uint8_t WOM_THR_ = 0x1F;
+  static constexpr uint8_t PWR_CYCLE_WOM_ = 0x20;
+  static constexpr uint8_t WOM_INT_ = 0x40;
+  /* Accel is at the +/-2g reset range during WOM calibration */
+  static constexpr float WOM_CAL_SCALE_MG_ = 2000.0f / 32767.5f;
+  static constexpr uint32_t WOM_CAL_MIN_SAMPLES_ = 10;
+  /* Needed for FIFO */
+  static constexpr uint8_t FIFO_EN_ = 0x23;
+  static constexpr uint8_t FIFO_DISABLE_ = 0x00;
+  static constexpr uint8_t FIFO_TEMP_GYRO_ACCEL_ = 0xF8;
+  static constexpr uint8_t FIFO_ENABLE_ = 0x40;
+  static constexpr uint8_t FIFO_RESET_ = 0x04;
+  static constexpr uint8_t FIFO_COUNT_ = 0x72;
+  static constexpr uint8_t FIFO_READ_ = 0x74;
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  /* Needed for the MPU-9250 I2C master, which reaches the AK8963 */
+  static constexpr uint8_t I2C_SLV0_ADDR_ = 0x25;
+  static constexpr uint8_t I2C_SLV0_REG_ = 0x26;
+  static constexpr uint8_t I2C_SLV0_CTRL_ = 0x27;
+  static constexpr uint8_t I2C_SLV0_DO_ = 0x63;
+  static constexpr uint8_t I2C_READ_FLAG_ = 0x80;
+  static constexpr uint8_t I2C_SLV0_EN_ = 0x80;
+  static constexpr uint8_t EXT_SENS_DATA_00_ = 0x49;
+  static constexpr uint8_t AK8963_I2C_ADDR_ = 0x0C;
+  #endif
+  /* FIFO frames match the ACCEL_XOUT - GYRO_ZOUT register order */
+  static constexpr size_t FIFO_FRAME_SIZE_ = 14;
+  static constexpr uint16_t FIFO_SIZE_ = 512;
+  /* FIFO_COUNT_H and FIFO_COUNT_L */
+  static constexpr uint8_t FIFO_COUNT_SIZE_ = 2;
+  /* Frames per transfer of the batch Read, bounded by its stack buffer */
+  static constexpr uint8_t READ_BURST_FRAMES_ = 4;
+  /* Whole frames per FIFO burst, limited by the longest read on the bus */
+  INVENSENSE_IMU_ISR_SAFE inline uint8_t burst_frames() const {
+    return imu_.max_read() / FIFO_FRAME_SIZE_;
+  }
+  /* Frames per burst into a READ_BURST_FRAMES_ stack buffer */
+  INVENSENSE_IMU_ISR_SAFE inline uint8_t read_burst_frames() const {
+    return (burst_frames() < READ_BURST_FRAMES_) ? burst_frames() :
+                                                   READ_BURST_FRAMES_;
+  }
+  static constexpr uint32_t SHOCK_TIMEOUT_MS_ = 100;
+  #if !defined(INVENSENSE_IMU_NO_WOM)
+  /* Time ReadShock last checked the WOM status, bounding the poll latency */
+  uint32_t shock_poll_ms_ = 0;
+  #endif
+  /* Utility functions */
+  bool WriteRegister(const uint8_t reg, const uint8_t data);
+  INVENSENSE_IMU_ISR_SAFE
+  bool ReadRegisters(const uint8_t reg, const uint8_t count,
+                     uint8_t * const data);
+  INVENSENSE_IMU_ISR_SAFE
+  bool ReadImu(uint8_t * const data, const uint8_t count);
+  INVENSENSE_IMU_ISR_SAFE bool ReadFifoCount(uint16_t * const count);
+  bool StartFifo();
+  bool ConfigDualPath(const CtrlRead read);
+  INVENSENSE_IMU_ISR_SAFE bool CtrlDeferred();
+  INVENSENSE_IMU_ISR_SAFE inline void LockLog() {log_busy_ = true;}
+  INVENSENSE_IMU_ISR_SAFE void UnlockLog();
+  INVENSENSE_IMU_ISR_SAFE bool CtrlDone(const bool status);
+  void ClearDualPath();
+  INVENSENSE_IMU_ISR_SAFE bool ReadRawBuffer(const uint8_t snapshot_size);
+  INVENSENSE_IMU_ISR_SAFE
+  void UnpackSample(const uint8_t * const frame, const float accel_scale,
+                    const float gyro_scale, Sample * const sample) const;
+  #if defined(INVENSENSE_IMU_LAZY)
+  INVENSENSE_IMU_ISR_SAFE void ConvertChannel(const uint8_t channel) const;
+  #endif
+  static bool AccelScale(const AccelRange range, float * const scale);
+  static bool GyroScale(const GyroRange range, float * const scale);
+  static bool ValidDlpf(const DlpfBandwidth dlpf);
+  void CommitAccelRange(const AccelRange range, const float scale);
+  void CommitGyroRange(const GyroRange range, const float scale);
+  bool SwitchConfig(const uint8_t reg, const uint8_t data,
+                    const float accel_scale, const float gyro_scale);
+  void RevertSwitch();
+  static void ExpectRegister(RegisterDump * const dump, const uint8_t reg,
+                             const uint8_t val);
+  /* Sequence engine */
+  void StartSequence(const Op * const seq, const SeqHook hook);
+  uint32_t seq_wait_remaining_ms() const;
+  bool RunSequence();
+  bool RunSequence(const Op * const seq);
+  bool RunHook(const uint8_t id);
+  bool StepVerifiedWrite(const uint8_t reg, const uint8_t data,
+                         const bool verify);
+  #if !defined(INVENSENSE_IMU_NO_MAG)
+  bool StepAux(const bool write, const uint8_t reg, const uint8_t data,
+               bool * const done);
+  #endif
+  #if !defined(INVENSENSE_IMU_NO_WOM)
+  bool ReadShockFrames(const uint16_t num_frames, ShockEvent * const event);
+  #endif
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_MPU_CORE_H_ NOLINT
@@ -0,0 +1,454 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu_core.h"  // NOLINT
+#include "mpu6500.h"  // NOLINT
+#include "mpu9250.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "Wire.h"
+#include "SPI.h"
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+
+/*
+* Data path, everything in this file is reachable from Read and may be called
+* from an interrupt, so it must never sleep. Any later use of delay or
+* WriteRegister is a compile error. The config path is in mpu_core.cpp,
+* mpu6500.cpp, and mpu9250.cpp.
+*/
+INVENSENSE_IMU_NO_SLEEP
+
+namespace bfs {
+
+bool MpuCore::ReadRegisters(const uint8_t reg, const uint8_t count,
+                            uint8_t * const data) {
+  return imu_.ReadRegisters(reg, count, spi_clock_, data);
+}
+bool MpuCore::ReadImu(uint8_t * const data, const uint8_t count) {
+  spi_clock_ = SPI_READ_CLOCK_;
+  /* Reset the new data flag */
+  new_imu_data_ = false;
+  /* Read the data registers, starting from INT_STATUS */
+  if (!ReadRegisters(INT_STATUS_, count, data)) {
+    return false;
+  }
+  /* Check if data is ready */
+  new_imu_data_ = (data[0] & RAW_DATA_RDY_INT_);
+  if (!new_imu_data_) {
+    return false;
+  }
+  /* Tag the first sample after a range or DLPF change */
+  config_changed_ = (switch_pending_ & SWITCH_SNAPSHOT_);
+  switch_pending_ &= ~(SWITCH_SNAPSHOT_ | SWITCH_COUNTS_);
+  /* Unpack the buffer */
+  accel_cnts_[0] = static_cast<int16_t>(data[1])  << 8 | data[2];
+  accel_cnts_[1] = static_cast<int16_t>(data[3])  << 8 | data[4];
+  accel_cnts_[2] = static_cast<int16_t>(data[5])  << 8 | data[6];
+  temp_cnts_ =     static_cast<int16_t>(data[7])  << 8 | data[8];
+  gyro_cnts_[0] =  static_cast<int16_t>(data[9])  << 8 | data[10];
+  gyro_cnts_[1] =  static_cast<int16_t>(data[11]) << 8 | data[12];
+  gyro_cnts_[2] =  static_cast<int16_t>(data[13]) << 8 | data[14];
+  #if defined(INVENSENSE_IMU_LAZY)
+  /* Defer the conversion until a channel is accessed */
+  dirty_ = ALL_DIRTY_;
+  #elif !defined(INVENSENSE_IMU_COMPACT)
+  /* Convert to float values and rotate the accel / gyro axis */
+  accel_[0] = static_cast<float>(accel_cnts_[1]) * accel_scale_ * G_MPS2_;
+  accel_[1] = static_cast<float>(accel_cnts_[0]) * accel_scale_ * G_MPS2_;
+  accel_[2] = static_cast<float>(accel_cnts_[2]) * accel_scale_ * -1.0f *
+              G_MPS2_;
+  temp_ = (static_cast<float>(temp_cnts_) - 21.0f) / TEMP_SCALE_ + 21.0f;
+  gyro_[0] = static_cast<float>(gyro_cnts_[1]) * gyro_scale_ * DEG2RAD_;
+  gyro_[1] = static_cast<float>(gyro_cnts_[0]) * gyro_scale_ * DEG2RAD_;
+  gyro_[2] = static_cast<float>(gyro_cnts_[2]) * gyro_scale_ * -1.0f * DEG2RAD_;
+  #endif
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  /* In dual path mode the logging path reports each sample instead */
+  if ((imu_cb_) && (!dual_path_)) {
+    Sample sample;
+    UnpackSample(&data[1], accel_scale_, gyro_scale_, &sample);
+    sample.config_changed = config_changed_;
+    imu_cb_(sample, imu_cb_context_);
+  }
+  #endif
+  return true;
+}
+#if defined(INVENSENSE_IMU_LAZY)
+void MpuCore::ConvertChannel(const uint8_t channel) const {
+  /* Convert to a float value and rotate the accel / gyro axis */
+  switch (channel) {
+    case ACCEL_X_DIRTY_: {
+      accel_[0] = static_cast<float>(accel_cnts_[1]) * accel_scale_ * G_MPS2_;
+      break;
+    }
+    case ACCEL_Y_DIRTY_: {
+      accel_[1] = static_cast<float>(accel_cnts_[0]) * accel_scale_ * G_MPS2_;
+      break;
+    }
+    case ACCEL_Z_DIRTY_: {
+      accel_[2] = static_cast<float>(accel_cnts_[2]) * accel_scale_ * -1.0f *
+                  G_MPS2_;
+      break;
+    }
+    case GYRO_X_DIRTY_: {
+      gyro_[0] = static_cast<float>(gyro_cnts_[1]) * gyro_scale_ * DEG2RAD_;
+      break;
+    }
+    case GYRO_Y_DIRTY_: {
+      gyro_[1] = static_cast<float>(gyro_cnts_[0]) * gyro_scale_ * DEG2RAD_;
+      break;
+    }
+    case GYRO_Z_DIRTY_: {
+      gyro_[2] = static_cast<float>(gyro_cnts_[2]) * gyro_scale_ * -1.0f *
+                 DEG2RAD_;
+      break;
+    }
+    case TEMP_DIRTY_: {
+      temp_ = (static_cast<float>(temp_cnts_) - 21.0f) / TEMP_SCALE_ + 21.0f;
+      break;
+    }
+  }
+  dirty_ &= ~channel;
+}
+#endif
+size_t MpuCore::Read(Sample * const samples, const size_t max_samples) {
+  if ((!samples) || (max_samples == 0)) {return 0;}
+  spi_clock_ = SPI_READ_CLOCK_;
+  /* Room for INT_STATUS and one frame */
+  uint8_t buf[FIFO_FRAME_SIZE_ + 1];
+  if (!fifo_enabled_) {
+    /* Read a single snapshot of the data registers, starting from INT_STATUS */
+    if (!ReadRegisters(INT_STATUS_, sizeof(buf), buf)) {
+      return 0;
+    }
+    if (!(buf[0] & RAW_DATA_RDY_INT_)) {
+      return 0;
+    }
+    UnpackSample(&buf[1], accel_scale_, gyro_scale_, &samples[0]);
+    samples[0].config_changed = (switch_pending_ & SWITCH_SNAPSHOT_);
+    switch_pending_ &= ~SWITCH_SNAPSHOT_;
+    #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+    if (imu_cb_) {imu_cb_(samples[0], imu_cb_context_);}
+    #endif
+    return 1;
+  }
+  uint16_t count;
+  if (!ReadFifoCount(&count)) {
+    return 0;
+  }
+  /* Discard any partial frame, left by an overflow, to realign */
+  if (count % FIFO_FRAME_SIZE_) {
+    LockLog();
+    const bool status = ReadRegisters(FIFO_READ_, count % FIFO_FRAME_SIZE_,
+                                      buf);
+    UnlockLog();
+    if (!status) {
+      return 0;
+    }
+  }
+  size_t num_samples = count / FIFO_FRAME_SIZE_;
+  if (num_samples > max_samples) {
+    num_samples = max_samples;
+  }
+  /*
+  * Read the frames in bursts, one frame per transfer in dual path mode to
+  * bound how long a control read can be deferred
+  */
+  uint8_t frames[READ_BURST_FRAMES_ * FIFO_FRAME_SIZE_];
+  const uint8_t max_burst = dual_path_ ? 1 : read_burst_frames();
+  for (size_t i = 0; i < num_samples;) {
+    const uint8_t burst = (num_samples - i > max_burst) ? max_burst :
+                          static_cast<uint8_t>(num_samples - i);
+    LockLog();
+    const bool status = ReadRegisters(FIFO_READ_, burst * FIFO_FRAME_SIZE_,
+                                      frames);
+    UnlockLog();
+    if (!status) {
+      return i;
+    }
+    /* Unpack each frame straight into the caller's array */
+    for (uint8_t j = 0; j < burst; j++, i++) {
+      const uint8_t * const frame = &frames[j * FIFO_FRAME_SIZE_];
+      /* Frames from before a range change use the previous scales */
+      if (prev_frames_) {
+        UnpackSample(frame, prev_accel_scale_, prev_gyro_scale_, &samples[i]);
+        samples[i].config_changed = false;
+        prev_frames_--;
+      } else {
+        UnpackSample(frame, accel_scale_, gyro_scale_, &samples[i]);
+        samples[i].config_changed = (tag_frames_ > 0);
+        if (tag_frames_) {tag_frames_--;}
+      }
+      #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+      if (imu_cb_) {imu_cb_(samples[i], imu_cb_context_);}
+      #endif
+    }
+  }
+  return num_samples;
+}
+bool MpuCore::ReadFifoCount(uint16_t * const count) {
+  uint8_t buf[FIFO_COUNT_SIZE_];
+  LockLog();
+  const bool status = ReadRegisters(FIFO_COUNT_, sizeof(buf), buf);
+  UnlockLog();
+  if (!status) {
+    return false;
+  }
+  *count = (static_cast<uint16_t>(buf[0]) << 8 | buf[1]) & 0x1FFF;
+  return true;
+}
+void MpuCore::UnpackSample(const uint8_t * const frame,
+                           const float accel_scale, const float gyro_scale,
+                           Sample * const sample) const {
+  int16_t accel[3], gyro[3], temp;
+  accel[0] = static_cast<int16_t>(frame[0])  << 8 | frame[1];
+  accel[1] = static_cast<int16_t>(frame[2])  << 8 | frame[3];
+  accel[2] = static_cast<int16_t>(frame[4])  << 8 | frame[5];
+  temp =     static_cast<int16_t>(frame[6])  << 8 | frame[7];
+  gyro[0] =  static_cast<int16_t>(frame[8])  << 8 | frame[9];
+  gyro[1] =  static_cast<int16_t>(frame[10]) << 8 | frame[11];
+  gyro[2] =  static_cast<int16_t>(frame[12]) << 8 | frame[13];
+  /* Convert to float values and rotate the accel / gyro axis */
+  sample->accel_x_mps2 = static_cast<float>(accel[1]) * accel_scale * G_MPS2_;
+  sample->accel_y_mps2 = static_cast<float>(accel[0]) * accel_scale * G_MPS2_;
+  sample->accel_z_mps2 = static_cast<float>(accel[2]) * accel_scale * -1.0f *
+                         G_MPS2_;
+  sample->gyro_x_radps = static_cast<float>(gyro[1]) * gyro_scale * DEG2RAD_;
+  sample->gyro_y_radps = static_cast<float>(gyro[0]) * gyro_scale * DEG2RAD_;
+  sample->gyro_z_radps = static_cast<float>(gyro[2]) * gyro_scale * -1.0f *
+                         DEG2RAD_;
+  sample->die_temp_c = (static_cast<float>(temp) - 21.0f) / TEMP_SCALE_ +
+                       21.0f;
+}
+bool MpuCore::CtrlDeferred() {
+  if (!dual_path_) {return false;}
+  if (log_busy_) {
+    /* The logging path is mid transfer, it runs the read when done */
+    ctrl_deferred_ = true;
+    num_deferred_ = num_deferred_ + 1;
+    return true;
+  }
+  /* A deferred read still pending is superseded by this one */
+  ctrl_deferred_ = false;
+  return false;
+}
+bool MpuCore::CtrlDone(const bool status) {
+  #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+  if ((status) && (dual_path_) && (ctrl_cb_)) {ctrl_cb_(ctrl_cb_context_);}
+  #endif
+  return status;
+}
+void MpuCore::UnlockLog() {
+  /*
+  * Clear the flag before checking for a deferred read, so a control read
+  * preempting in between either runs directly or is caught by the loop
+  */
+  log_busy_ = false;
+  while (ctrl_deferred_) {
+    log_busy_ = true;
+    ctrl_deferred_ = false;
+    ctrl_read_(this);
+    log_busy_ = false;
+  }
+}
+MpuCore::RawBuffer *MpuCore::AcquireRaw() {
+  if (!raw_bufs_) {return nullptr;}
+  RawBuffer *buf = &raw_bufs_[raw_acquire_idx_];
+  if (buf->state != RAW_FILLED_) {return nullptr;}
+  buf->state = RAW_ACQUIRED_;
+  raw_acquire_idx_ = (raw_acquire_idx_ + 1) % num_raw_bufs_;
+  return buf;
+}
+void MpuCore::ReleaseRaw(RawBuffer * const buf) {
+  if ((!buf) || (buf->state != RAW_ACQUIRED_)) {return;}
+  buf->len = 0;
+  buf->state = RAW_FREE_;
+}
+bool MpuCore::ReadRawBuffer(const uint8_t snapshot_size) {
+  if (!raw_bufs_) {return false;}
+  /* The oldest buffer must be free, otherwise the pool is exhausted */
+  RawBuffer *buf = &raw_bufs_[raw_fill_idx_];
+  if (buf->state != RAW_FREE_) {return false;}
+  spi_clock_ = SPI_READ_CLOCK_;
+  if (!fifo_enabled_) {
+    /* Register snapshot, read straight into the buffer */
+    if (buf->size < snapshot_size) {return false;}
+    if (!ReadRegisters(INT_STATUS_, snapshot_size, buf->data)) {
+      return false;
+    }
+    if (!(buf->data[0] & RAW_DATA_RDY_INT_)) {
+      return false;
+    }
+    buf->len = snapshot_size;
+    buf->fifo_frames = false;
+  } else {
+    uint16_t count;
+    if (!ReadFifoCount(&count)) {
+      return false;
+    }
+    /* Discard any partial frame, left by an overflow, to realign */
+    if (count % FIFO_FRAME_SIZE_) {
+      uint8_t discard[FIFO_FRAME_SIZE_];
+      LockLog();
+      const bool status = ReadRegisters(FIFO_READ_, count % FIFO_FRAME_SIZE_,
+                                        discard);
+      UnlockLog();
+      if (!status) {
+        return false;
+      }
+    }
+    uint16_t num_frames = count / FIFO_FRAME_SIZE_;
+    if (num_frames > buf->size / FIFO_FRAME_SIZE_) {
+      num_frames = buf->size / FIFO_FRAME_SIZE_;
+    }
+    if (num_frames == 0) {
+      return false;
+    }
+    /*
+    * Burst the frames straight into the buffer, one frame per transfer in
+    * dual path mode to bound how long a control read can be deferred
+    */
+    const uint8_t max_burst = dual_path_ ? 1 : burst_frames();
+    uint16_t len = 0;
+    while (num_frames > 0) {
+      uint8_t burst = (num_frames > max_burst) ? max_burst : num_frames;
+      LockLog();
+      const bool status = ReadRegisters(FIFO_READ_, burst * FIFO_FRAME_SIZE_,
+                                        buf->data + len);
+      UnlockLog();
+      if (!status) {
+        return false;
+      }
+      len += burst * FIFO_FRAME_SIZE_;
+      num_frames -= burst;
+    }
+    /* Frames from before and around a range change have been consumed */
+    uint16_t frames = len / FIFO_FRAME_SIZE_;
+    if (frames > prev_frames_) {
+      frames -= prev_frames_;
+      prev_frames_ = 0;
+      tag_frames_ = (tag_frames_ > frames) ? tag_frames_ - frames : 0;
+    } else {
+      prev_frames_ -= frames;
+    }
+    buf->len = len;
+    buf->fifo_frames = true;
+  }
+  /* Hand the buffer over to the consumer */
+  buf->state = RAW_FILLED_;
+  raw_fill_idx_ = (raw_fill_idx_ + 1) % num_raw_bufs_;
+  return true;
+}
+bool Mpu6500::Read() {
+  if (CtrlDeferred()) {return false;}
+  return CtrlDone(ReadLatest());
+}
+bool Mpu6500::DeferredRead(MpuCore * const core) {
+  Mpu6500 * const imu = static_cast<Mpu6500 *>(core);
+  return imu->CtrlDone(imu->ReadLatest());
+}
+bool Mpu6500::ReadLatest() {
+  #if defined(INVENSENSE_IMU_COMPACT)
+  /* The compact layout keeps the raw buffer on the stack */
+  uint8_t data_buf[DATA_BUF_SIZE_];
+  return ReadImu(data_buf, sizeof(data_buf));
+  #else
+  return ReadImu(data_buf_, sizeof(data_buf_));
+  #endif
+}
+bool Mpu9250::Read() {
+  if (CtrlDeferred()) {return false;}
+  return CtrlDone(ReadLatest());
+}
+bool Mpu9250::DeferredRead(MpuCore * const core) {
+  Mpu9250 * const imu = static_cast<Mpu9250 *>(core);
+  return imu->CtrlDone(imu->ReadLatest());
+}
+bool Mpu9250::ReadLatest() {
+  #if defined(INVENSENSE_IMU_COMPACT)
+  /* The compact layout keeps the raw buffer on the stack */
+  uint8_t data_buf[DATA_BUF_SIZE_];
+  #else
+  uint8_t * const data_buf = data_buf_;
+  #endif
+  #if defined(INVENSENSE_IMU_NO_MAG)
+  return ReadImu(data_buf, DATA_BUF_SIZE_);
+  #else
+  /* Reset the new data flags */
+  new_mag_data_ = false;
+  /* Read and unpack the IMU data */
+  if (!ReadImu(data_buf, DATA_BUF_SIZE_)) {
+    return false;
+  }
+  /* Check for new mag data */
+  new_mag_data_ = (data_buf[15] & AK8963_DATA_RDY_INT_);
+  /* Check for mag overflow */
+  mag_sensor_overflow_ = (data_buf[22] & AK8963_HOFL_);
+  if (mag_sensor_overflow_) {
+    new_mag_data_ = false;
+    #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+    if (mag_overflow_cb_) {mag_overflow_cb_(mag_overflow_cb_context_);}
+    #endif
+  }
+  /* Only update on new data */
+  if (new_mag_data_) {
+    mag_cnts_[0] = static_cast<int16_t>(data_buf[17]) << 8 | data_buf[16];
+    mag_cnts_[1] = static_cast<int16_t>(data_buf[19]) << 8 | data_buf[18];
+    mag_cnts_[2] = static_cast<int16_t>(data_buf[21]) << 8 | data_buf[20];
+    #if defined(INVENSENSE_IMU_LAZY)
+    /* Defer the conversion until an axis is accessed */
+    mag_dirty_ = MAG_ALL_DIRTY_;
+    #elif !defined(INVENSENSE_IMU_COMPACT)
+    mag_[0] = static_cast<float>(mag_cnts_[0]) * mag_scale_[0];
+    mag_[1] = static_cast<float>(mag_cnts_[1]) * mag_scale_[1];
+    mag_[2] = static_cast<float>(mag_cnts_[2]) * mag_scale_[2];
+    #endif
+    #if !defined(INVENSENSE_IMU_NO_CALLBACK)
+    if (mag_cb_) {
+      MagSample sample;
+      sample.mag_x_ut = static_cast<float>(mag_cnts_[0]) * mag_scale_[0];
+      sample.mag_y_ut = static_cast<float>(mag_cnts_[1]) * mag_scale_[1];
+      sample.mag_z_ut = static_cast<float>(mag_cnts_[2]) * mag_scale_[2];
+      mag_cb_(sample, mag_cb_context_);
+    }
+    #endif
+  }
+  return true;
+  #endif
+}
+#if !defined(INVENSENSE_IMU_NO_MAG)
+#if defined(INVENSENSE_IMU_LAZY)
+void Mpu9250::ConvertMag(const uint8_t axis) const {
+  mag_[axis] = static_cast<float>(mag_cnts_[axis]) * mag_scale_[axis];
+  mag_dirty_ &= ~(1 << axis);
+}
+#endif
+#endif
+
+}  // namespace bfs
@@ -0,0 +1,232 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "mpu_synth.h"  // NOLINT
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+#include "mpu_batch.h"  // NOLINT
+
+namespace bfs {
+
+namespace {
+/* Die temperature, the inverse of (cnts - 21) / 333.87 + 21 */
+constexpr float TEMP_SENS = 333.87f;
+constexpr float TEMP_OFFSET = 21.0f;
+/* AK8963 16 bit output saturates at +/-32760 counts */
+constexpr float MAG_MAX_CNT = 32760.0f;
+constexpr uint8_t AK8963_ST1_DRDY = 0x01;
+constexpr uint8_t AK8963_ST2_HOFL = 0x08;
+constexpr uint8_t AK8963_ST2_BITM = 0x10;
+constexpr float TWO_PI = 6.28318530718f;
+/* Scales the top 24 bits of a draw to [0, 1) */
+constexpr float U24_SCALE = 1.0f / 16777216.0f;
+
+/* Rounds to the nearest even count, lrintf is in avr-libc unlike nearbyintf */
+int16_t Quantize(const float val, const float min, const float max) {
+  if (val > max) {return static_cast<int16_t>(max);}
+  if (val < min) {return static_cast<int16_t>(min);}
+  return static_cast<int16_t>(lrintf(val));
+}
+void PutBe(const int16_t cnt, uint8_t * const p) {
+  p[0] = static_cast<uint8_t>(static_cast<uint16_t>(cnt) >> 8);
+  p[1] = static_cast<uint8_t>(cnt);
+}
+}  // namespace
+
+void ImuSynth::Config(const Trajectory trajectory, void * const context,
+                      const float rate_hz) {
+  trajectory_ = trajectory;
+  context_ = context;
+  dt_s_ = 1.0f / rate_hz;
+  t_s_ = 0.0;
+}
+
+void ImuSynth::ConfigNoise(const ImuNoise &noise, const uint32_t seed) {
+  noise_ = noise;
+  /* xorshift can not leave a zero state */
+  state_ = seed ? seed : 1;
+  has_spare_ = false;
+  for (size_t i = 0; i < 3; i++) {
+    accel_bias_[i] = 0.0f;
+    gyro_bias_[i] = 0.0f;
+  }
+}
+
+void ImuSynth::ConfigAttitude(const float quat[4]) {
+  const float n = sqrtf(quat[0] * quat[0] + quat[1] * quat[1] +
+                        quat[2] * quat[2] + quat[3] * quat[3]);
+  for (size_t i = 0; i < 4; i++) {
+    quat_[i] = quat[i] / n;
+  }
+}
+
+void ImuSynth::ConfigMagField(const float mag_ned_ut[3]) {
+  for (size_t i = 0; i < 3; i++) {
+    mag_ned_ut_[i] = mag_ned_ut[i];
+  }
+}
+
+void ImuSynth::Step(ImuValues * const ideal, ImuValues * const measured) {
+  TrajectoryPoint pt = {};
+  if (trajectory_) {trajectory_(t_s_, &pt, context_);}
+  /* Specific force is the acceleration less gravity, down is positive */
+  const float f_ned[3] = {
+    pt.accel_ned_mps2[0], pt.accel_ned_mps2[1], pt.accel_ned_mps2[2] - G_MPS2_
+  };
+  ImuValues truth;
+  Rotate(f_ned, truth.accel_mps2);
+  Rotate(mag_ned_ut_, truth.mag_ut);
+  for (size_t i = 0; i < 3; i++) {
+    truth.gyro_radps[i] = pt.gyro_radps[i];
+  }
+  truth.die_temp_c = pt.die_temp_c;
+  if (ideal) {*ideal = truth;}
+  if (measured) {
+    const float walk = sqrtf(dt_s_);
+    const float d_temp = pt.die_temp_c - noise_.ref_temp_c;
+    for (size_t i = 0; i < 3; i++) {
+      accel_bias_[i] += noise_.accel_bias_walk_mps2 * walk * Gauss();
+      gyro_bias_[i] += noise_.gyro_bias_walk_radps * walk * Gauss();
+      measured->accel_mps2[i] = truth.accel_mps2[i] + accel_bias_[i] +
+                                noise_.accel_temp_mps2_per_c * d_temp +
+                                noise_.accel_mps2 * Gauss();
+      measured->gyro_radps[i] = truth.gyro_radps[i] + gyro_bias_[i] +
+                                noise_.gyro_temp_radps_per_c * d_temp +
+                                noise_.gyro_radps * Gauss();
+      measured->mag_ut[i] = truth.mag_ut[i] + noise_.mag_ut * Gauss();
+    }
+    measured->die_temp_c = truth.die_temp_c;
+  }
+  /* Integrate the attitude, q = q * [1, w * dt / 2], and normalize */
+  const float h = 0.5f * dt_s_;
+  const float wx = pt.gyro_radps[0] * h;
+  const float wy = pt.gyro_radps[1] * h;
+  const float wz = pt.gyro_radps[2] * h;
+  const float q0 = quat_[0], q1 = quat_[1], q2 = quat_[2], q3 = quat_[3];
+  quat_[0] = q0 - q1 * wx - q2 * wy - q3 * wz;
+  quat_[1] = q1 + q0 * wx + q2 * wz - q3 * wy;
+  quat_[2] = q2 + q0 * wy - q1 * wz + q3 * wx;
+  quat_[3] = q3 + q0 * wz + q1 * wy - q2 * wx;
+  const float n = 1.0f / sqrtf(quat_[0] * quat_[0] + quat_[1] * quat_[1] +
+                               quat_[2] * quat_[2] + quat_[3] * quat_[3]);
+  for (size_t i = 0; i < 4; i++) {
+    quat_[i] *= n;
+  }
+  t_s_ += dt_s_;
+}
+
+float ImuSynth::Gauss() {
+  if (has_spare_) {
+    has_spare_ = false;
+    return spare_;
+  }
+  /* Box-Muller on two xorshift32 draws, u1 in (0, 1] */
+  uint32_t r[2];
+  for (size_t i = 0; i < 2; i++) {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    r[i] = state_;
+  }
+  const float u1 = (static_cast<float>(r[0] >> 8) + 1.0f) * U24_SCALE;
+  const float u2 = static_cast<float>(r[1] >> 8) * U24_SCALE;
+  const float mag = sqrtf(-2.0f * logf(u1));
+  spare_ = mag * sinf(TWO_PI * u2);
+  has_spare_ = true;
+  return mag * cosf(TWO_PI * u2);
+}
+
+void ImuSynth::Rotate(const float ned[3], float body[3]) const {
+  /* body = R' * ned, with R the rotation from body to NED */
+  const float q0 = quat_[0], q1 = quat_[1], q2 = quat_[2], q3 = quat_[3];
+  body[0] = (1.0f - 2.0f * (q2 * q2 + q3 * q3)) * ned[0] +
+            2.0f * (q1 * q2 + q0 * q3) * ned[1] +
+            2.0f * (q1 * q3 - q0 * q2) * ned[2];
+  body[1] = 2.0f * (q1 * q2 - q0 * q3) * ned[0] +
+            (1.0f - 2.0f * (q1 * q1 + q3 * q3)) * ned[1] +
+            2.0f * (q2 * q3 + q0 * q1) * ned[2];
+  body[2] = 2.0f * (q1 * q3 + q0 * q2) * ned[0] +
+            2.0f * (q2 * q3 - q0 * q1) * ned[1] +
+            (1.0f - 2.0f * (q1 * q1 + q2 * q2)) * ned[2];
+}
+
+void PackImuFrame(const ImuValues &values, const float accel_scale_mps2,
+                  const float gyro_scale_radps, uint8_t * const frame) {
+  if (!frame) {return;}
+  /* Sensor x and y are swapped and z is negated, the inverse of Read */
+  const float a = 1.0f / accel_scale_mps2;
+  const float g = 1.0f / gyro_scale_radps;
+  const float cnts[7] = {
+    values.accel_mps2[1] * a, values.accel_mps2[0] * a,
+    -values.accel_mps2[2] * a,
+    (values.die_temp_c - TEMP_OFFSET) * TEMP_SENS + TEMP_OFFSET,
+    values.gyro_radps[1] * g, values.gyro_radps[0] * g,
+    -values.gyro_radps[2] * g
+  };
+  for (size_t i = 0; i < 7; i++) {
+    PutBe(Quantize(cnts[i], -32768.0f, 32767.0f), frame + 2 * i);
+  }
+}
+
+void RecordImuFrames(ImuSynth * const synth, const size_t num_frames,
+                     const float accel_scale_mps2,
+                     const float gyro_scale_radps, uint8_t * const frames) {
+  if ((!synth) || (!frames)) {return;}
+  ImuValues measured;
+  for (size_t i = 0; i < num_frames; i++) {
+    synth->Step(nullptr, &measured);
+    PackImuFrame(measured, accel_scale_mps2, gyro_scale_radps,
+                 frames + i * IMU_FRAME_SIZE);
+  }
+}
+
+void PackMagData(const float mag_ut[3], const float mag_scale_ut[3],
+                 uint8_t * const data) {
+  if (!data) {return;}
+  bool ovf = false;
+  data[0] = AK8963_ST1_DRDY;
+  for (size_t i = 0; i < 3; i++) {
+    const float cnt = mag_ut[i] / mag_scale_ut[i];
+    /* Overflows if it rounds past the range */
+    if ((cnt > MAG_MAX_CNT + 0.5f) || (cnt < -MAG_MAX_CNT - 0.5f)) {
+      ovf = true;
+    }
+    const int16_t val = Quantize(cnt, -MAG_MAX_CNT, MAG_MAX_CNT);
+    /* Little endian, HXL first */
+    data[1 + 2 * i] = static_cast<uint8_t>(val);
+    data[2 + 2 * i] = static_cast<uint8_t>(static_cast<uint16_t>(val) >> 8);
+  }
+  data[7] = AK8963_ST2_BITM | (ovf ? AK8963_ST2_HOFL : 0);
+}
+
+}  // namespace bfs
@@ -0,0 +1,144 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_MPU_SYNTH_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_MPU_SYNTH_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+
+namespace bfs {
+
+/*
+* Sensor values in the frame of the Mpu6500 and Mpu9250 accessors: x
+* forward, y right, z down. The accelerometer measures specific force, so a
+* level sensor at rest reads -9.81 m/s/s on z.
+*/
+struct ImuValues {
+  float accel_mps2[3];
+  float gyro_radps[3];
+  float mag_ut[3];
+  float die_temp_c;
+};
+
+/* Motion at one instant, the body angular rate and the NED acceleration */
+struct TrajectoryPoint {
+  float gyro_radps[3];
+  float accel_ned_mps2[3];
+  float die_temp_c;
+};
+using Trajectory = void (*)(const double t_s, TrajectoryPoint * const point,
+                            void *context);
+
+/* Sensor error model, all zero for ideal values */
+struct ImuNoise {
+  /* White noise standard deviation, per sample */
+  float accel_mps2;
+  float gyro_radps;
+  float mag_ut;
+  /* Bias random walk, standard deviation growth per root second */
+  float accel_bias_walk_mps2;
+  float gyro_bias_walk_radps;
+  /* Bias change per degree C away from ref_temp_c */
+  float accel_temp_mps2_per_c;
+  float gyro_temp_radps_per_c;
+  float ref_temp_c;
+};
+
+/*
+* Synthetic data generator. Integrates the attitude from the trajectory's
+* angular rate and gives the ideal specific force, angular rate, and
+* magnetic field at each sample, along with the values measured by a sensor
+* with the given error model. PackImuFrame and PackMagData encode the
+* measured values into register data, which is quantized at the sensor's
+* ranges.
+*/
+class ImuSynth {
+ public:
+  void Config(const Trajectory trajectory, void * const context,
+              const float rate_hz);
+  void ConfigNoise(const ImuNoise &noise, const uint32_t seed);
+  /* Initial attitude, quaternion from body to NED, scalar first */
+  void ConfigAttitude(const float quat[4]);
+  /* Earth magnetic field in NED, uT */
+  void ConfigMagField(const float mag_ned_ut[3]);
+  void Step(ImuValues * const ideal, ImuValues * const measured);
+  inline double t_s() const {return t_s_;}
+
+ private:
+  static constexpr float G_MPS2_ = 9.80665f;
+  Trajectory trajectory_ = nullptr;
+  void *context_ = nullptr;
+  double t_s_ = 0.0;
+  float dt_s_ = 0.001f;
+  float quat_[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+  float mag_ned_ut_[3] = {0.0f, 0.0f, 0.0f};
+  ImuNoise noise_ = {};
+  float accel_bias_[3] = {0.0f, 0.0f, 0.0f};
+  float gyro_bias_[3] = {0.0f, 0.0f, 0.0f};
+  /* Gaussian numbers are made in pairs */
+  uint32_t state_ = 1;
+  float spare_;
+  bool has_spare_ = false;
+  float Gauss();
+  void Rotate(const float ned[3], float body[3]) const;
+};
+
+/*
+* Encodes values in the accessor frame as the data registers from
+* ACCEL_XOUT_H through GYRO_ZOUT_L, which is also the FIFO frame layout; the
+* inverse of Read and UnpackImuFrames. The scales are per count, i.e.
+* accel_scale_mps2 and gyro_scale_radps. Values are rounded to the nearest
+* count and saturate at the range.
+*/
+void PackImuFrame(const ImuValues &values, const float accel_scale_mps2,
+                  const float gyro_scale_radps, uint8_t * const frame);
+/*
+* Steps the generator num_frames times and packs the measured values into
+* frames, back to back, giving a recording to replay through FIFO consumers
+* and loggers. Frames must hold num_frames * IMU_FRAME_SIZE bytes.
+*/
+void RecordImuFrames(ImuSynth * const synth, const size_t num_frames,
+                     const float accel_scale_mps2,
+                     const float gyro_scale_radps, uint8_t * const frames);
+/*
+* Encodes a magnetic field as the 8 bytes of AK8963 data, ST1 through ST2,
+* which the MPU-9250 reads into EXT_SENS_DATA. Sets the overflow flag if the
+* field saturates. The scales are per axis and count, which the MPU-9250
+* sets from the AK8963 sensitivity adjustment.
+*/
+void PackMagData(const float mag_ut[3], const float mag_scale_ut[3],
+                 uint8_t * const data);
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_MPU_SYNTH_H_ NOLINT
@@ -0,0 +1,188 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_MPU_TIMING_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_MPU_TIMING_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include "core/core.h"
+#endif
+#include "mpu6500.h"  // NOLINT
+#include "mpu9250.h"  // NOLINT
+
+namespace bfs {
+
+/*
+* Compile time model of the bus time used by reading several sensors on one
+* shared bus, built from the transfers the driver makes: one burst from
+* INT_STATUS per Read, which includes EXT_SENS_DATA on the MPU-9250, and a
+* FIFO count followed by one transfer per frame for the batch Read. Used to
+* check a board configuration before it is built, i.e. with static_assert.
+*/
+class MpuTiming {
+ public:
+  struct Bus {
+    bool i2c;
+    uint32_t clock_hz;
+    /* Fixed time per transfer: CS setup, driver and interrupt latency */
+    float overhead_us;
+  };
+  struct Load {
+    /* Bus transfers and data bytes read per second */
+    float transfers_per_s;
+    float bytes_per_s;
+    /* Fraction of the bus time used, and the fraction left */
+    float occupancy;
+    float headroom;
+    /* Worst case time from a sample to its data being read */
+    float latency_us;
+    /* Whether every sample is read, with none missed or overflowed */
+    bool fits;
+  };
+  /* Frames held by the FIFO, and bytes of the count read before a drain */
+  static constexpr uint8_t FIFO_FRAMES = MpuCore::FIFO_SIZE_ /
+                                         MpuCore::FIFO_FRAME_SIZE_;
+  static constexpr uint8_t FIFO_COUNT_SIZE = MpuCore::FIFO_COUNT_SIZE_;
+  static constexpr Bus I2c(const uint32_t clock_hz = 400000,
+                           const float overhead_us = 10.0f) {
+    return Bus{true, clock_hz, overhead_us};
+  }
+  static constexpr Bus Spi(
+      const uint32_t clock_hz = MpuCore::SPI_READ_CLOCK_,
+      const float overhead_us = 2.0f) {
+    return Bus{false, clock_hz, overhead_us};
+  }
+  /* Sample rate for a sample rate divider, with the DLPF enabled */
+  static constexpr float SampleRateHz(const uint8_t srd) {
+    return 1000.0f / (1.0f + srd);
+  }
+  /* Duration of one ReadRegisters of count bytes */
+  static constexpr float ReadUs(const Bus &bus, const uint16_t count) {
+    return bus.overhead_us + 1e6f * static_cast<float>(bus.i2c ?
+           I2C_READ_BITS_ + I2C_BYTE_BITS_ * count :
+           SPI_BYTE_BITS_ * (1 + count)) / static_cast<float>(bus.clock_hz);
+  }
+  /*
+  * num_sensors of type Imu, each sampling at the same rate and read once per
+  * sample with Read, i.e. from the data ready interrupt.
+  */
+  template<typename Imu>
+  static constexpr Load Snapshot(const Bus &bus, const size_t num_sensors,
+                                 const uint8_t srd) {
+    return Snapshot(bus, num_sensors, srd, Imu::DATA_BUF_SIZE_);
+  }
+  /* FIFO frames per transfer of the batch Read */
+  static constexpr uint8_t BurstFrames(const Bus &bus) {
+    return (bus.i2c && (InvensenseImu::I2C_MAX_READ /
+                        MpuCore::FIFO_FRAME_SIZE_ <
+                        MpuCore::READ_BURST_FRAMES_)) ?
+           InvensenseImu::I2C_MAX_READ / MpuCore::FIFO_FRAME_SIZE_ :
+           MpuCore::READ_BURST_FRAMES_;
+  }
+  /* Duration of reading num_frames FIFO frames with the batch Read */
+  static constexpr float FramesUs(const Bus &bus, const float num_frames) {
+    return static_cast<float>(Ceil(num_frames / BurstFrames(bus))) *
+           ReadUs(bus, 0) + num_frames *
+           (ReadUs(bus, MpuCore::FIFO_FRAME_SIZE_) - ReadUs(bus, 0));
+  }
+  /*
+  * num_sensors each sampling at the same rate and drained with the batch
+  * Read drain_hz times per second.
+  */
+  static constexpr Load Fifo(const Bus &bus, const size_t num_sensors,
+                             const uint8_t srd, const float drain_hz) {
+    /* Frames per drain on average, and drains of all sensors per second */
+    return FifoLoad(bus, num_sensors, srd, drain_hz,
+                    SampleRateHz(srd) / drain_hz,
+                    drain_hz * static_cast<float>(num_sensors));
+  }
+
+ private:
+  /* I2C: start, address, register, repeated start, address, stop */
+  static constexpr uint32_t I2C_READ_BITS_ = 1 + 9 + 9 + 1 + 9 + 1;
+  /* I2C data bytes are followed by an acknowledge bit */
+  static constexpr uint32_t I2C_BYTE_BITS_ = 9;
+  static constexpr uint32_t SPI_BYTE_BITS_ = 8;
+  static constexpr uint32_t Ceil(const float val) {
+    return static_cast<uint32_t>(val) +
+           (val > static_cast<float>(static_cast<uint32_t>(val)) ? 1 : 0);
+  }
+  /*
+  * The loads are built in stages of single return statements, for C++11
+  * constexpr, which the Arduino AVR core compiles with.
+  */
+  static constexpr Load Snapshot(const Bus &bus, const size_t num_sensors,
+                                 const uint8_t srd, const uint8_t count) {
+    /* All sensors sample together, the last is read after the others */
+    return SnapshotLoad(srd, count,
+                        SampleRateHz(srd) * static_cast<float>(num_sensors),
+                        ReadUs(bus, count),
+                        static_cast<float>(num_sensors) * ReadUs(bus, count));
+  }
+  static constexpr Load SnapshotLoad(const uint8_t srd, const uint8_t count,
+                                     const float rate, const float read_us,
+                                     const float latency_us) {
+    /* Each sample must be read before the next overwrites it */
+    return Load{rate, rate * count, rate * read_us * 1e-6f,
+                1.0f - rate * read_us * 1e-6f, latency_us,
+                (rate * read_us * 1e-6f < 1.0f) &&
+                (latency_us < 1e6f / SampleRateHz(srd))};
+  }
+  static constexpr Load FifoLoad(const Bus &bus, const size_t num_sensors,
+                                 const uint8_t srd, const float drain_hz,
+                                 const float frames,
+                                 const float drain_hz_total) {
+    /*
+    * A sample taken just after a drain waits for the next drain of all,
+    * each reading at most Ceil(frames) frames
+    */
+    return FifoFits(srd, Load{
+      drain_hz_total * (1.0f + Ceil(frames / BurstFrames(bus))),
+      drain_hz_total * (FIFO_COUNT_SIZE + frames * MpuCore::FIFO_FRAME_SIZE_),
+      drain_hz_total * (ReadUs(bus, FIFO_COUNT_SIZE) + FramesUs(bus, frames)) *
+      1e-6f,
+      0.0f,
+      1e6f / drain_hz + static_cast<float>(num_sensors) *
+      (ReadUs(bus, FIFO_COUNT_SIZE) +
+       FramesUs(bus, static_cast<float>(Ceil(frames)))),
+      false});
+  }
+  static constexpr Load FifoFits(const uint8_t srd, const Load &load) {
+    /* Frames collected until the last sensor is drained must fit the FIFO */
+    return Load{load.transfers_per_s, load.bytes_per_s, load.occupancy,
+                1.0f - load.occupancy, load.latency_us,
+                (load.occupancy < 1.0f) &&
+                (Ceil(load.latency_us * 1e-6f * SampleRateHz(srd)) <=
+                 FIFO_FRAMES)};
+  }
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_MPU_TIMING_H_ NOLINT
@@ -0,0 +1,113 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#ifndef INVENSENSE_IMU_SRC_SPSC_QUEUE_H_  // NOLINT
+#define INVENSENSE_IMU_SRC_SPSC_QUEUE_H_
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#if !defined(INVENSENSE_IMU_HOST)
+#include "core/core.h"
+#endif
+#endif
+#include <atomic>
+
+namespace bfs {
+
+/*
+* Bounded, lock-free, single producer and single consumer queue of N items,
+* N a power of 2. One thread, or an interrupt, pushes and one other thread
+* pops; neither ever blocks. Items are copied in and out, so batches are
+* usually handed off by pointer. The push and pop calls taking an array move
+* as many items as fit with one atomic update.
+*/
+template<typename T, size_t N>
+class SpscQueue {
+ public:
+  static_assert((N >= 2) && ((N & (N - 1)) == 0), "N must be a power of 2");
+  bool Push(const T &item) {return Push(&item, 1) == 1;}
+  bool Pop(T * const item) {return Pop(item, 1) == 1;}
+  size_t Push(const T * const items, const size_t count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    /* Reload the consumer index only when the cached one shows no room */
+    if (N - (tail - head_cache_) < count) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+    }
+    const size_t free = N - (tail - head_cache_);
+    const size_t num = (count < free) ? count : free;
+    for (size_t i = 0; i < num; i++) {
+      buf_[(tail + i) & MASK_] = items[i];
+    }
+    tail_.store(tail + num, std::memory_order_release);
+    return num;
+  }
+  size_t Pop(T * const items, const size_t max) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (tail_cache_ - head < max) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+    }
+    const size_t avail = tail_cache_ - head;
+    const size_t num = (max < avail) ? max : avail;
+    for (size_t i = 0; i < num; i++) {
+      items[i] = buf_[(head + i) & MASK_];
+    }
+    head_.store(head + num, std::memory_order_release);
+    return num;
+  }
+  /* Approximate when called while the other side is active */
+  inline size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  inline bool empty() const {return size() == 0;}
+  static constexpr size_t capacity() {return N;}
+
+ private:
+  static constexpr size_t MASK_ = N - 1;
+  /*
+  * The producer and consumer indices are kept on separate cache lines on a
+  * host to avoid false sharing; Cortex-M parts have no cache to share.
+  */
+  #if defined(ARDUINO) || \
+      (defined(__ARM_ARCH_PROFILE) && (__ARM_ARCH_PROFILE == 'M'))
+  static constexpr size_t LINE_ = 4;
+  #else
+  static constexpr size_t LINE_ = 64;
+  #endif
+  /* Consumer index, and the consumer's copy of the producer index */
+  alignas(LINE_) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+  /* Producer index, and the producer's copy of the consumer index */
+  alignas(LINE_) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+  alignas(LINE_) T buf_[N];
+};
+
+}  // namespace bfs
+
+#endif  // INVENSENSE_IMU_SRC_SPSC_QUEUE_H_ NOLINT
@@ -0,0 +1,348 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+#include "core/core.h"  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+
+SPIClass SPI;
+TwoWire Wire;
+
+namespace {
+/* Registers */
+constexpr uint8_t SMPLRT_DIV = 0x19;
+constexpr uint8_t FIFO_EN = 0x23;
+constexpr uint8_t I2C_SLV0_ADDR = 0x25;
+constexpr uint8_t I2C_SLV0_REG = 0x26;
+constexpr uint8_t I2C_SLV0_CTRL = 0x27;
+constexpr uint8_t INT_STATUS = 0x3A;
+constexpr uint8_t ACCEL_XOUT_H = 0x3B;
+constexpr uint8_t EXT_SENS_DATA_00 = 0x49;
+constexpr uint8_t EXT_SENS_DATA_23 = 0x60;
+constexpr uint8_t I2C_SLV0_DO = 0x63;
+constexpr uint8_t USER_CTRL = 0x6A;
+constexpr uint8_t PWR_MGMT_1 = 0x6B;
+constexpr uint8_t FIFO_COUNTH = 0x72;
+constexpr uint8_t FIFO_COUNTL = 0x73;
+constexpr uint8_t FIFO_R_W = 0x74;
+constexpr uint8_t WHO_AM_I = 0x75;
+/* Register bits */
+constexpr uint8_t RAW_DATA_RDY_INT = 0x01;
+constexpr uint8_t FIFO_OFLOW_INT = 0x10;
+constexpr uint8_t FIFO_ENABLE = 0x40;
+constexpr uint8_t I2C_MST_EN = 0x20;
+constexpr uint8_t FIFO_RESET = 0x04;
+constexpr uint8_t USER_CTRL_SELF_CLEAR = 0x07;
+constexpr uint8_t H_RESET = 0x80;
+constexpr uint8_t SLEEP = 0x40;
+constexpr uint8_t I2C_SLV_EN = 0x80;
+constexpr uint8_t I2C_READ_FLAG = 0x80;
+/* AK8963 */
+constexpr uint8_t AK8963_I2C_ADDR = 0x0C;
+constexpr uint8_t AK8963_WIA = 0x00;
+constexpr uint8_t AK8963_ST1 = 0x02;
+constexpr uint8_t AK8963_HXL = 0x03;
+constexpr uint8_t AK8963_ST2 = 0x09;
+constexpr uint8_t AK8963_CNTL1 = 0x0A;
+constexpr uint8_t AK8963_CNTL2 = 0x0B;
+constexpr uint8_t AK8963_ASA = 0x10;
+constexpr uint8_t AK8963_REG_MASK = 0x1F;
+constexpr uint8_t AK8963_WHOAMI = 0x48;
+constexpr uint8_t AK8963_MODE_MASK = 0x0F;
+constexpr uint8_t AK8963_CNT_MEAS2 = 0x06;
+constexpr uint8_t AK8963_BIT = 0x10;
+constexpr uint8_t AK8963_DRDY = 0x01;
+constexpr uint8_t AK8963_RESET = 0x01;
+/* The AK8963 measures at 100 Hz, every 10 samples at 1 kHz */
+constexpr uint32_t AK8963_SAMPLES = 10;
+/* Accel, temperature, and gyro frame */
+constexpr uint8_t NUM_CH = 7;
+constexpr uint8_t FRAME_SIZE = 2 * NUM_CH;
+constexpr uint32_t SAMPLE_US = 1000;
+SimMpu *sim_mpu = nullptr;
+uint64_t sim_time_us = 0;
+const char *trap_path = nullptr;
+
+void Sleep(const char * const name, const uint32_t val, const uint32_t us) {
+  if (trap_path) {
+    fprintf(stderr, "%s: %s(%u) called\n", trap_path, name, val);
+    abort();
+  }
+  SimAdvance(us);
+}
+}  // namespace
+
+void SimMpu::PowerOn() {
+  memset(regs_, 0, sizeof(regs_));
+  memset(ak_regs_, 0, sizeof(ak_regs_));
+  regs_[PWR_MGMT_1] = 0x01;
+  ak_regs_[AK8963_WIA] = AK8963_WHOAMI;
+  ak_regs_[AK8963_ASA] = 0x80;
+  ak_regs_[AK8963_ASA + 1] = 0x80;
+  ak_regs_[AK8963_ASA + 2] = 0x80;
+  fifo_head_ = 0;
+  fifo_len_ = 0;
+  fifo_count_ = 0;
+  awake_ = false;
+  elapsed_us_ = 0;
+}
+
+int16_t SimMpu::Counts(const uint32_t k, const uint8_t channel) {
+  return static_cast<int16_t>((k % 4000) * 8 + channel);
+}
+
+int16_t SimMpu::MagCounts(const uint32_t k, const uint8_t axis) {
+  return static_cast<int16_t>((k % 4000) * 4 + axis);
+}
+
+void SimMpu::Advance(const uint32_t us) {
+  elapsed_us_ += us;
+  uint32_t period_us = SAMPLE_US * (1 + regs_[SMPLRT_DIV]);
+  while (elapsed_us_ >= period_us) {
+    elapsed_us_ -= period_us;
+    Sample();
+    period_us = SAMPLE_US * (1 + regs_[SMPLRT_DIV]);
+  }
+}
+
+void SimMpu::Sample() {
+  if (!awake_) {return;}
+  const uint32_t k = ++num_samples_;
+  uint8_t frame[FRAME_SIZE];
+  for (uint8_t c = 0; c < NUM_CH; c++) {
+    const uint16_t cnt = static_cast<uint16_t>(Counts(k, c));
+    frame[2 * c] = cnt >> 8;
+    frame[2 * c + 1] = cnt & 0xFF;
+  }
+  memcpy(&regs_[ACCEL_XOUT_H], frame, sizeof(frame));
+  regs_[INT_STATUS] |= RAW_DATA_RDY_INT;
+  if ((regs_[USER_CTRL] & FIFO_ENABLE) && (regs_[FIFO_EN])) {
+    /* Overwrite the oldest data when full */
+    if (fifo_len_ + sizeof(frame) > FIFO_SIZE) {
+      const size_t drop = fifo_len_ + sizeof(frame) - FIFO_SIZE;
+      fifo_head_ = (fifo_head_ + drop) % FIFO_SIZE;
+      fifo_len_ -= drop;
+      regs_[INT_STATUS] |= FIFO_OFLOW_INT;
+    }
+    for (size_t i = 0; i < sizeof(frame); i++) {
+      fifo_[(fifo_head_ + fifo_len_++) % FIFO_SIZE] = frame[i];
+    }
+  }
+  if (whoami_ == WHOAMI_MPU6500) {return;}
+  if (((ak_regs_[AK8963_CNTL1] & AK8963_MODE_MASK) == AK8963_CNT_MEAS2) &&
+      (k % AK8963_SAMPLES == 0)) {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+      const uint16_t cnt = static_cast<uint16_t>(MagCounts(k, axis));
+      ak_regs_[AK8963_HXL + 2 * axis] = cnt & 0xFF;
+      ak_regs_[AK8963_HXL + 2 * axis + 1] = cnt >> 8;
+    }
+    ak_regs_[AK8963_ST1] |= AK8963_DRDY;
+    ak_regs_[AK8963_ST2] = ak_regs_[AK8963_CNTL1] & AK8963_BIT;
+  }
+  RunSlave0();
+}
+
+void SimMpu::RunSlave0() {
+  if ((!(regs_[USER_CTRL] & I2C_MST_EN)) ||
+      (!(regs_[I2C_SLV0_CTRL] & I2C_SLV_EN)) ||
+      ((regs_[I2C_SLV0_ADDR] & ~I2C_READ_FLAG) != AK8963_I2C_ADDR)) {
+    return;
+  }
+  const uint8_t reg = regs_[I2C_SLV0_REG] & AK8963_REG_MASK;
+  if (regs_[I2C_SLV0_ADDR] & I2C_READ_FLAG) {
+    const uint8_t len = regs_[I2C_SLV0_CTRL] & 0x0F;
+    for (uint8_t i = 0; i < len; i++) {
+      const uint8_t ak_reg = (reg + i) & AK8963_REG_MASK;
+      if (EXT_SENS_DATA_00 + i <= EXT_SENS_DATA_23) {
+        regs_[EXT_SENS_DATA_00 + i] = ak_regs_[ak_reg];
+      }
+      /* Reading ST2 ends the measurement */
+      if (ak_reg == AK8963_ST2) {ak_regs_[AK8963_ST1] &= ~AK8963_DRDY;}
+    }
+  } else if (reg == AK8963_CNTL1) {
+    ak_regs_[AK8963_CNTL1] = regs_[I2C_SLV0_DO];
+  } else if ((reg == AK8963_CNTL2) && (regs_[I2C_SLV0_DO] & AK8963_RESET)) {
+    ak_regs_[AK8963_CNTL1] = 0;
+  }
+}
+
+uint8_t SimMpu::ReadRegister(const uint8_t reg) {
+  switch (reg) {
+    case INT_STATUS: {
+      const uint8_t status = regs_[INT_STATUS];
+      regs_[INT_STATUS] = 0;
+      return status;
+    }
+    case FIFO_COUNTH: {
+      /* Reading the high byte latches the count */
+      fifo_count_ = static_cast<uint16_t>(fifo_len_);
+      return fifo_count_ >> 8;
+    }
+    case FIFO_COUNTL: {
+      return fifo_count_ & 0xFF;
+    }
+    case FIFO_R_W: {
+      if (fifo_len_ == 0) {return 0xFF;}
+      const uint8_t data = fifo_[fifo_head_];
+      fifo_head_ = (fifo_head_ + 1) % FIFO_SIZE;
+      fifo_len_--;
+      return data;
+    }
+    case WHO_AM_I: {
+      return whoami_;
+    }
+    default: {
+      return regs_[reg & 0x7F];
+    }
+  }
+}
+
+void SimMpu::WriteRegister(const uint8_t reg, const uint8_t data) {
+  /* Status, data, FIFO, and WHO_AM_I registers are read only */
+  if (((reg >= INT_STATUS) && (reg <= EXT_SENS_DATA_23)) ||
+      (reg >= FIFO_COUNTH)) {
+    return;
+  }
+  switch (reg) {
+    case PWR_MGMT_1: {
+      if (data & H_RESET) {
+        PowerOn();
+        return;
+      }
+      regs_[PWR_MGMT_1] = data;
+      awake_ = !(data & SLEEP);
+      return;
+    }
+    case USER_CTRL: {
+      if (data & FIFO_RESET) {
+        fifo_head_ = 0;
+        fifo_len_ = 0;
+      }
+      regs_[USER_CTRL] = data & ~USER_CTRL_SELF_CLEAR;
+      return;
+    }
+    default: {
+      regs_[reg] = data;
+      return;
+    }
+  }
+}
+
+void SimConnect(SimMpu * const mpu) {
+  sim_mpu = mpu;
+  SPI.mpu_ = mpu;
+  Wire.mpu_ = mpu;
+}
+
+void SimAdvance(const uint32_t us) {
+  sim_time_us += us;
+  if (sim_mpu) {sim_mpu->Advance(us);}
+}
+
+void SimTrapSleep(const char * const path) {
+  trap_path = path;
+}
+
+uint32_t millis() {
+  return static_cast<uint32_t>(sim_time_us / 1000);
+}
+
+uint32_t micros() {
+  return static_cast<uint32_t>(sim_time_us);
+}
+
+void delay(uint32_t ms) {
+  Sleep("delay", ms, ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  Sleep("delayMicroseconds", us, us);
+}
+
+uint8_t SPIClass::transfer(const uint8_t data) {
+  if (first_) {
+    first_ = false;
+    reg_ = data & ~I2C_READ_FLAG;
+    read_ = data & I2C_READ_FLAG;
+    return 0;
+  }
+  if (!mpu_) {return 0xFF;}
+  if (read_) {return mpu_->ReadRegister(reg_++);}
+  mpu_->WriteRegister(reg_++, data);
+  return 0;
+}
+
+void SPIClass::transfer(void * const buf, const size_t count) {
+  uint8_t * const data = static_cast<uint8_t *>(buf);
+  for (size_t i = 0; i < count; i++) {
+    if (!read_) {
+      transfer(data[i]);
+    } else if (!mpu_) {
+      data[i] = 0xFF;
+    } else {
+      /* FIFO reads do not advance the address */
+      data[i] = mpu_->ReadRegister(reg_);
+      if (reg_ != FIFO_R_W) {reg_++;}
+    }
+  }
+}
+
+void TwoWire::beginTransmission(const uint8_t addr) {
+  addr_ = addr;
+  tx_len_ = 0;
+}
+
+size_t TwoWire::write(const uint8_t data) {
+  if ((!mpu_) || (addr_ != SimMpu::I2C_ADDR)) {return 0;}
+  if (tx_len_++ == 0) {
+    reg_ = data;
+  } else {
+    mpu_->WriteRegister(reg_++, data);
+  }
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(const bool) {
+  /* Address NACK */
+  if ((!mpu_) || (addr_ != SimMpu::I2C_ADDR)) {return 2;}
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(const uint8_t addr, const uint8_t count) {
+  rx_len_ = 0;
+  rx_pos_ = 0;
+  if ((!mpu_) || (addr != SimMpu::I2C_ADDR)) {return 0;}
+  rx_len_ = (count > BUFFER_SIZE) ? BUFFER_SIZE : count;
+  for (size_t i = 0; i < rx_len_; i++) {
+    rx_[i] = mpu_->ReadRegister(reg_);
+    if (reg_ != FIFO_R_W) {reg_++;}
+  }
+  return static_cast<uint8_t>(rx_len_);
+}
+
+int TwoWire::read() {
+  if (rx_pos_ >= rx_len_) {return -1;}
+  return rx_[rx_pos_++];
+}
@@ -0,0 +1,154 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Simulated core for the host tests, standing in for the Bolder Flight core
+* so the driver builds and runs on a host. The SPI and I2C buses talk to a
+* simulated MPU-6500 or MPU-9250, and time only advances when the test calls
+* SimAdvance or the driver sleeps.
+*/
+
+#ifndef INVENSENSE_IMU_TESTS_HOST_CORE_CORE_H_  // NOLINT
+#define INVENSENSE_IMU_TESTS_HOST_CORE_CORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define RISING 3
+#define MSBFIRST 1
+#define SPI_MODE3 3
+
+/*
+* Register model of an MPU-6500 or MPU-9250: the data registers, INT_STATUS
+* cleared on read, a 512 byte FIFO of accel, temperature, and gyro frames,
+* and, on the MPU-9250, I2C slave 0 reading and writing an AK8963. Channel
+* c of sample k reads Counts(k, c). Sampling stops on a reset until
+* PWR_MGMT_1 is written again.
+*/
+class SimMpu {
+ public:
+  static constexpr uint8_t WHOAMI_MPU6500 = 0x70;
+  static constexpr uint8_t WHOAMI_MPU9250 = 0x71;
+  static constexpr uint8_t I2C_ADDR = 0x68;
+  static constexpr size_t FIFO_SIZE = 512;
+  explicit SimMpu(const uint8_t whoami) : whoami_(whoami) {PowerOn();}
+  void PowerOn();
+  /* Samples at the rate set by SMPLRT_DIV */
+  void Advance(const uint32_t us);
+  uint8_t ReadRegister(const uint8_t reg);
+  void WriteRegister(const uint8_t reg, const uint8_t data);
+  inline uint32_t num_samples() const {return num_samples_;}
+  inline size_t fifo_len() const {return fifo_len_;}
+  static int16_t Counts(const uint32_t k, const uint8_t channel);
+  static int16_t MagCounts(const uint32_t k, const uint8_t axis);
+
+ private:
+  void Sample();
+  void RunSlave0();
+  uint8_t whoami_;
+  uint8_t regs_[128];
+  uint8_t ak_regs_[32];
+  uint8_t fifo_[FIFO_SIZE];
+  size_t fifo_head_, fifo_len_;
+  uint16_t fifo_count_;
+  bool awake_;
+  uint32_t elapsed_us_;
+  uint32_t num_samples_ = 0;
+};
+
+/* Connects the sensor to SPI, Wire, and the clock */
+void SimConnect(SimMpu * const mpu);
+/* Advances the clock, sampling the connected sensor */
+void SimAdvance(const uint32_t us);
+/*
+* While trapping, any delay or delayMicroseconds aborts the test, naming
+* the path under test; nullptr stops trapping.
+*/
+void SimTrapSleep(const char * const path);
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline void attachInterrupt(uint8_t, void (*)(), int) {}
+inline uint8_t digitalPinToInterrupt(uint8_t pin) {return pin;}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class SPISettings {
+ public:
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+ public:
+  void begin() {}
+  void beginTransaction(SPISettings) {first_ = true;}
+  uint8_t transfer(const uint8_t data);
+  void transfer(void * const buf, const size_t count);
+  void endTransaction() {}
+
+ private:
+  friend void SimConnect(SimMpu * const mpu);
+  SimMpu *mpu_ = nullptr;
+  bool first_ = true;
+  uint8_t reg_ = 0;
+  bool read_ = false;
+};
+
+class TwoWire {
+ public:
+  /* Wire receive buffer on many platforms, e.g. AVR */
+  static constexpr size_t BUFFER_SIZE = 32;
+  void begin() {}
+  void setClock(uint32_t) {}
+  void beginTransmission(const uint8_t addr);
+  size_t write(const uint8_t data);
+  uint8_t endTransmission(const bool stop = true);
+  uint8_t requestFrom(const uint8_t addr, const uint8_t count);
+  int read();
+
+ private:
+  friend void SimConnect(SimMpu * const mpu);
+  SimMpu *mpu_ = nullptr;
+  uint8_t addr_ = 0;
+  size_t tx_len_ = 0;
+  uint8_t reg_ = 0;
+  uint8_t rx_[BUFFER_SIZE];
+  size_t rx_len_ = 0, rx_pos_ = 0;
+};
+
+extern SPIClass SPI;
+extern TwoWire Wire;
+
+#endif  // INVENSENSE_IMU_TESTS_HOST_CORE_CORE_H_ NOLINT
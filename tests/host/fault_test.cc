@@ -0,0 +1,316 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Drives Read, the batch Read, and ReadRaw on a simulated MPU-6500 and
+* MPU-9250, over SPI and I2C, through phases of injected bus faults, and
+* checks the error paths:
+*  - while the sensor reads as reset, every call returns false or 0
+*  - a failed I2C transfer is reported: false, 0, or only the samples read
+*    before it, which are all valid
+*  - with I2C NACKs and short reads, no corrupted value is ever returned
+*  - after the faults stop, the data path returns valid data again, with
+*    Begin tried again after 20 ms without data, as an application would
+* Bit flips, stuck values, SPI faults, and a reset in the middle of a call
+* corrupt data that reports success, so only recovery is checked for them.
+* Reports the valid samples returned, the throughput lost, and the
+* recovery time of each phase.
+*/
+
+#include <cstdio>
+#include "core/core.h"
+#include "mpu6500.h"
+#include "mpu9250.h"
+#include "fault_injector.h"
+#include "sim_checks.h"
+
+namespace {
+/* Calls per phase */
+constexpr int NUM_CALLS = 5000;
+constexpr size_t MAX_SAMPLES = 64;
+constexpr size_t FRAME_SIZE = 14;
+/* Application recovery: initialize again after this long without data */
+constexpr uint32_t RECOVERY_TIMEOUT_MS = 20;
+/* Valid calls in a row, and the calls allowed, to recover */
+constexpr int RECOVERED_CALLS = 10;
+constexpr int MAX_RECOVERY_CALLS = 2000;
+constexpr uint8_t NUM_RAW_BUFS = 2;
+constexpr uint16_t RAW_BUF_SIZE = 36 * FRAME_SIZE;
+uint8_t raw_data[NUM_RAW_BUFS][RAW_BUF_SIZE];
+bfs::MpuCore::RawBuffer raw_bufs[NUM_RAW_BUFS];
+int failures = 0;
+
+enum Path {
+  READ,
+  BATCH_REGS,
+  BATCH_FIFO,
+  RAW_REGS,
+  RAW_FIFO,
+  NUM_PATHS
+};
+constexpr const char *PATH_NAMES[NUM_PATHS] = {
+  "Read",
+  "batch Read, data registers",
+  "batch Read, FIFO",
+  "ReadRaw, data registers",
+  "ReadRaw, FIFO"
+};
+inline bool UsesFifo(const Path path) {
+  return (path == BATCH_FIFO) || (path == RAW_FIFO);
+}
+
+/* Fault rates per transfer, in parts per million */
+struct Phase {
+  const char *name;
+  bfs::FaultInjector::Rates rates;
+};
+constexpr Phase PHASES[] = {
+  {"None",       {0,     0,     0,     0,    0,    0}},
+  {"NACK",       {20000, 0,     0,     0,    0,    0}},
+  {"Short read", {0,     20000, 0,     0,    0,    0}},
+  {"Bit flip",   {0,     0,     20000, 0,    0,    0}},
+  {"Stuck",      {0,     0,     0,     5000, 0,    20}},
+  {"Reset",      {0,     0,     0,     0,    2000, 0}},
+  {"All",        {20000, 20000, 20000, 5000, 2000, 20}}
+};
+constexpr bfs::FaultInjector::Rates NO_FAULTS = {0, 0, 0, 0, 0, 0};
+
+/* Outcome of one call */
+struct Result {
+  /* Reported success, i.e. true or at least one sample */
+  bool ok;
+  /* Returned every sample available */
+  bool complete;
+  /* Every value returned is from the simulated samples, in order */
+  bool valid;
+  size_t num_samples;
+};
+
+/* Checks frames read from the FIFO, which must be consecutive */
+bool ValidFrames(const uint8_t * const frames, const size_t num) {
+  for (size_t i = 0; i < num; i++) {
+    const int32_t k = FrameIndex(&frames[i * FRAME_SIZE]);
+    if (k < 0) {return false;}
+    if ((i > 0) &&
+        (k != (FrameIndex(&frames[(i - 1) * FRAME_SIZE]) + 1) % SIM_PERIOD)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class Imu>
+Result Call(Imu * const imu, const SimMpu &mpu, const Path path) {
+  Result r = {false, false, true, 0};
+  const size_t avail = UsesFifo(path) ? mpu.fifo_len() / FRAME_SIZE : 1;
+  switch (path) {
+    case READ: {
+      r.ok = imu->Read();
+      r.complete = r.ok;
+      r.valid = (!r.ok) || (LatestIndex(*imu) == SimIndex(mpu));
+      r.num_samples = r.ok ? 1 : 0;
+      break;
+    }
+    case BATCH_REGS:
+    case BATCH_FIFO: {
+      bfs::MpuCore::Sample samples[MAX_SAMPLES];
+      const size_t n = imu->Read(samples, MAX_SAMPLES);
+      const float accel_scale = imu->accel_scale_mps2();
+      const float gyro_scale = imu->gyro_scale_radps();
+      int32_t prev = -1;
+      for (size_t i = 0; i < n; i++) {
+        const int32_t k = SampleIndex(samples[i], accel_scale, gyro_scale);
+        if ((k < 0) || ((path == BATCH_REGS) && (k != SimIndex(mpu))) ||
+            ((prev >= 0) && (k != (prev + 1) % SIM_PERIOD))) {
+          r.valid = false;
+        }
+        prev = k;
+      }
+      r.ok = (n > 0);
+      r.complete = (n == ((avail > MAX_SAMPLES) ? MAX_SAMPLES : avail));
+      r.num_samples = n;
+      break;
+    }
+    case RAW_REGS:
+    case RAW_FIFO: {
+      r.ok = imu->ReadRaw();
+      bfs::MpuCore::RawBuffer *buf;
+      while ((buf = imu->AcquireRaw())) {
+        if (buf->fifo_frames) {
+          r.num_samples += buf->len / FRAME_SIZE;
+          r.valid = r.valid && ValidFrames(buf->data, buf->len / FRAME_SIZE);
+        } else {
+          r.num_samples++;
+          r.valid = r.valid && (FrameIndex(&buf->data[1]) == SimIndex(mpu));
+        }
+        imu->ReleaseRaw(buf);
+      }
+      r.complete = r.ok && ((r.num_samples == avail) ||
+                            (r.num_samples == RAW_BUF_SIZE / FRAME_SIZE));
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  return r;
+}
+
+/* Initializes the sensor for the path */
+template<class Imu>
+bool Init(Imu * const imu, const Path path) {
+  return (imu->Begin()) && ((!UsesFifo(path)) || (imu->EnableFifo()));
+}
+
+/* Application side recovery state */
+struct Recovery {
+  uint32_t t_good_ms;
+  bool recovering;
+  uint32_t num;
+  uint32_t total_ms;
+};
+
+/*
+* Tries to initialize again after RECOVERY_TIMEOUT_MS without data, and on
+* every call after that until data returns
+*/
+template<class Imu>
+void Recover(Imu * const imu, const Path path, const bool ok,
+             Recovery * const rec) {
+  if (ok) {
+    if (rec->recovering) {
+      rec->total_ms += millis() - rec->t_good_ms;
+      rec->recovering = false;
+    }
+    rec->t_good_ms = millis();
+  } else if (millis() - rec->t_good_ms > RECOVERY_TIMEOUT_MS) {
+    if (!rec->recovering) {rec->num++;}
+    rec->recovering = true;
+    Init(imu, path);
+  }
+}
+
+template<class Imu>
+void RunPath(const uint8_t whoami, const bool i2c, const Path path,
+             const char * const name) {
+  printf("%s, %s\n", name, PATH_NAMES[path]);
+  SimMpu mpu(whoami);
+  SimConnect(&mpu);
+  Imu imu;
+  if (i2c) {
+    imu.Config(&Wire, bfs::MpuCore::I2C_ADDR_PRIM);
+  } else {
+    imu.Config(&SPI, 10);
+  }
+  for (uint8_t i = 0; i < NUM_RAW_BUFS; i++) {
+    raw_bufs[i] = {raw_data[i], RAW_BUF_SIZE, 0, false, 0};
+  }
+  Expect(Init(&imu, path), "initializing", &failures);
+  Expect(imu.ConfigRawPool(raw_bufs, NUM_RAW_BUFS), "ConfigRawPool",
+         &failures);
+  bfs::FaultInjector faults;
+  imu.ConfigFaults(&faults);
+  size_t baseline = 0;
+  for (const Phase &phase : PHASES) {
+    faults.Config(phase.rates);
+    faults.ClearCounts();
+    /* Only bus errors that are reported leave every value checkable */
+    const bool checked = (phase.rates.bit_flip_ppm == 0) &&
+                         (phase.rates.stuck_ppm == 0) &&
+                         (i2c || ((phase.rates.nack_ppm == 0) &&
+                                  (phase.rates.short_read_ppm == 0)));
+    Recovery rec = {millis(), false, 0, 0};
+    size_t num_samples = 0;
+    int num_ok = 0;
+    for (int i = 0; i < NUM_CALLS; i++) {
+      SimAdvance(1000 * (1 + i % 5));
+      const bool was_reset = faults.reset();
+      const bfs::FaultInjector::Counts before = faults.counts();
+      const Result r = Call(&imu, mpu, path);
+      const bfs::FaultInjector::Counts &after = faults.counts();
+      const bool reported = i2c && ((after.nack != before.nack) ||
+                                    (after.short_read != before.short_read));
+      if (was_reset) {
+        Expect(!r.ok, "call while reset returned data", &failures);
+      }
+      if (checked && (after.reset == before.reset)) {
+        if (reported) {
+          Expect(!r.complete, "failed I2C transfer not reported", &failures);
+        }
+        Expect(r.valid, "corrupted data returned", &failures);
+      }
+      if (r.valid) {num_samples += r.num_samples;}
+      if (r.ok) {num_ok++;}
+      Recover(&imu, path, r.ok, &rec);
+    }
+    if (baseline == 0) {baseline = num_samples;}
+    /* Stop the faults, the data path must return valid data again */
+    faults.Config(NO_FAULTS);
+    Recovery end = {millis(), false, 0, 0};
+    const uint32_t t0 = millis();
+    int streak = 0;
+    for (int i = 0; (i < MAX_RECOVERY_CALLS) && (streak < RECOVERED_CALLS);
+         i++) {
+      SimAdvance(1000 * (1 + i % 5));
+      const Result r = Call(&imu, mpu, path);
+      streak = (r.ok && r.valid) ? streak + 1 : 0;
+      Recover(&imu, path, r.ok, &end);
+    }
+    Expect(streak >= RECOVERED_CALLS, "no recovery after the faults stop",
+           &failures);
+    const bfs::FaultInjector::Counts &c = faults.counts();
+    printf("  %-10s %5d/%d calls ok, %6zu valid samples, %5.1f%% loss, "
+           "%u recoveries (mean %.1f ms), recovered in %u ms, injected %u "
+           "NACK, %u short, %u flip, %u stuck, %u reset\n",
+           phase.name, num_ok, NUM_CALLS, num_samples,
+           100.0 * (1.0 - static_cast<double>(num_samples) / baseline),
+           rec.num, rec.num ? static_cast<double>(rec.total_ms) / rec.num : 0,
+           millis() - t0, c.nack, c.short_read, c.bit_flip, c.stuck,
+           c.reset);
+  }
+  imu.ConfigFaults(nullptr);
+  SimConnect(nullptr);
+}
+
+template<class Imu>
+void Run(const uint8_t whoami, const bool i2c, const char * const name) {
+  for (int path = 0; path < NUM_PATHS; path++) {
+    RunPath<Imu>(whoami, i2c, static_cast<Path>(path), name);
+  }
+}
+}  // namespace
+
+int main() {
+  Run<bfs::Mpu6500>(SimMpu::WHOAMI_MPU6500, false, "MPU-6500, SPI");
+  Run<bfs::Mpu6500>(SimMpu::WHOAMI_MPU6500, true, "MPU-6500, I2C");
+  Run<bfs::Mpu9250>(SimMpu::WHOAMI_MPU9250, false, "MPU-9250, SPI");
+  Run<bfs::Mpu9250>(SimMpu::WHOAMI_MPU9250, true, "MPU-9250, I2C");
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("Every error path reported the fault and recovered\n");
+  return 0;
+}
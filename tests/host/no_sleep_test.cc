@@ -0,0 +1,171 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Drives the data path, Read, the batch Read, and ReadRaw, with every sleep
+* trapped, on a simulated MPU-6500 and MPU-9250 over SPI and I2C, with the
+* data registers, the FIFO, and dual path mode. A delay or delayMicroseconds
+* reached from any of them, directly or through a callee in another file,
+* aborts the test. The INVENSENSE_IMU_NO_SLEEP poison only catches sleeps
+* written in the data path files.
+*/
+
+#include <cstdio>
+#include "core/core.h"
+#include "mpu6500.h"
+#include "mpu9250.h"
+#include "sim_checks.h"
+
+namespace {
+/* Calls per path */
+constexpr int NUM_CALLS = 1000;
+constexpr size_t MAX_SAMPLES = 64;
+/* Raw buffers, room for a full FIFO */
+constexpr uint8_t NUM_RAW_BUFS = 4;
+constexpr uint16_t RAW_BUF_SIZE = 36 * 14;
+uint8_t raw_data[NUM_RAW_BUFS][RAW_BUF_SIZE];
+bfs::MpuCore::RawBuffer raw_bufs[NUM_RAW_BUFS];
+int failures = 0;
+
+/* Time between calls, with an occasional FIFO overflow */
+uint32_t Interval(const int call) {
+  return (call % 100 == 99) ? 100000 : 1000 * (1 + call % 20);
+}
+
+template<class Imu>
+void ReadLatest(Imu * const imu, const SimMpu &mpu, const char * const path) {
+  int good = 0;
+  SimTrapSleep(path);
+  for (int i = 0; i < NUM_CALLS; i++) {
+    SimAdvance(1000);
+    if ((imu->Read()) && (LatestIndex(*imu) == SimIndex(mpu))) {good++;}
+    /* Nothing new */
+    if (imu->Read()) {good--;}
+  }
+  SimTrapSleep(nullptr);
+  Expect(good == NUM_CALLS, path, &failures);
+}
+
+template<class Imu>
+void ReadBatch(Imu * const imu, const char * const path) {
+  bfs::MpuCore::Sample samples[MAX_SAMPLES];
+  size_t total = 0, bad = 0;
+  SimTrapSleep(path);
+  for (int i = 0; i < NUM_CALLS; i++) {
+    SimAdvance(Interval(i));
+    const size_t n = imu->Read(samples, MAX_SAMPLES);
+    for (size_t j = 0; j < n; j++) {
+      if (SampleIndex(samples[j], imu->accel_scale_mps2(),
+                      imu->gyro_scale_radps()) < 0) {bad++;}
+    }
+    total += n;
+  }
+  SimTrapSleep(nullptr);
+  Expect((total >= NUM_CALLS) && (bad == 0), path, &failures);
+}
+
+template<class Imu>
+void ReadRaw(Imu * const imu, const char * const path) {
+  size_t total = 0, bad = 0;
+  SimTrapSleep(path);
+  for (int i = 0; i < NUM_CALLS; i++) {
+    SimAdvance(Interval(i));
+    imu->ReadRaw();
+    bfs::MpuCore::RawBuffer *buf;
+    while ((buf = imu->AcquireRaw())) {
+      /* A snapshot starts with INT_STATUS */
+      const size_t first = buf->fifo_frames ? 0 : 1;
+      for (size_t j = first; j + 14 <= buf->len; j += 14) {
+        if (FrameIndex(&buf->data[j]) < 0) {bad++;}
+        total++;
+        if (!buf->fifo_frames) {break;}
+      }
+      imu->ReleaseRaw(buf);
+    }
+  }
+  SimTrapSleep(nullptr);
+  Expect((total >= NUM_CALLS) && (bad == 0), path, &failures);
+}
+
+/* Control reads interleaved with the logging path */
+template<class Imu>
+void ReadDualPath(Imu * const imu, const char * const path) {
+  bfs::MpuCore::Sample samples[MAX_SAMPLES];
+  int good = 0;
+  SimTrapSleep(path);
+  for (int i = 0; i < NUM_CALLS; i++) {
+    SimAdvance(1000);
+    if (imu->Read()) {good++;}
+    imu->Read(samples, MAX_SAMPLES);
+    SimAdvance(1000);
+    if (imu->Read()) {good++;}
+    imu->ReadRaw();
+    bfs::MpuCore::RawBuffer *buf;
+    while ((buf = imu->AcquireRaw())) {imu->ReleaseRaw(buf);}
+  }
+  SimTrapSleep(nullptr);
+  Expect(good == 2 * NUM_CALLS, path, &failures);
+}
+
+template<class Imu>
+void Run(Imu * const imu, const uint8_t whoami, const char * const name) {
+  printf("%s\n", name);
+  SimMpu mpu(whoami);
+  SimConnect(&mpu);
+  /* Configuration may sleep */
+  Expect(imu->Begin(), "Begin", &failures);
+  for (uint8_t i = 0; i < NUM_RAW_BUFS; i++) {
+    raw_bufs[i] = {raw_data[i], RAW_BUF_SIZE, 0, false, 0};
+  }
+  Expect(imu->ConfigRawPool(raw_bufs, NUM_RAW_BUFS), "ConfigRawPool",
+         &failures);
+  ReadLatest(imu, mpu, "Read");
+  ReadBatch(imu, "batch Read, data registers");
+  ReadRaw(imu, "ReadRaw, data registers");
+  Expect(imu->EnableFifo(), "EnableFifo", &failures);
+  ReadBatch(imu, "batch Read, FIFO");
+  ReadRaw(imu, "ReadRaw, FIFO");
+  Expect(imu->EnableDualPath(), "EnableDualPath", &failures);
+  ReadDualPath(imu, "dual path");
+  SimConnect(nullptr);
+}
+}  // namespace
+
+int main() {
+  bfs::Mpu6500 mpu6500_spi(&SPI, 10);
+  Run(&mpu6500_spi, SimMpu::WHOAMI_MPU6500, "MPU-6500, SPI");
+  bfs::Mpu6500 mpu6500_i2c(&Wire, bfs::Mpu6500::I2C_ADDR_PRIM);
+  Run(&mpu6500_i2c, SimMpu::WHOAMI_MPU6500, "MPU-6500, I2C");
+  bfs::Mpu9250 mpu9250_spi(&SPI, 10);
+  Run(&mpu9250_spi, SimMpu::WHOAMI_MPU9250, "MPU-9250, SPI");
+  bfs::Mpu9250 mpu9250_i2c(&Wire, bfs::Mpu9250::I2C_ADDR_PRIM);
+  Run(&mpu9250_i2c, SimMpu::WHOAMI_MPU9250, "MPU-9250, I2C");
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("No sleeps on the data path\n");
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+* Brian R Taylor
+* brian.taylor@bolderflight.com
+* 
+* Copyright (c) 2022 Bolder Flight Systems Inc
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the “Software”), to
+* deal in the Software without restriction, including without limitation the
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+* sell copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*/
+
+/*
+* Checks of the data read from the simulated sensor, shared by the host
+* tests.
+*/
+
+#ifndef INVENSENSE_IMU_TESTS_HOST_SIM_CHECKS_H_  // NOLINT
+#define INVENSENSE_IMU_TESTS_HOST_SIM_CHECKS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include "core/core.h"
+#include "mpu_core.h"
+
+/* Samples are identified modulo this, see SimMpu::Counts */
+static constexpr int32_t SIM_PERIOD = 4000;
+
+/*
+* Index, modulo SIM_PERIOD, of the simulated sample the values were
+* converted from, or -1 if they are not all from one sample
+*/
+inline int32_t SampleIndex(const bfs::MpuCore::Sample &s,
+                           const float accel_scale, const float gyro_scale) {
+  const float cnts[7] = {
+    s.accel_y_mps2 / accel_scale,
+    s.accel_x_mps2 / accel_scale,
+    -s.accel_z_mps2 / accel_scale,
+    (s.die_temp_c - 21.0f) * 333.87f + 21.0f,
+    s.gyro_y_radps / gyro_scale,
+    s.gyro_x_radps / gyro_scale,
+    -s.gyro_z_radps / gyro_scale
+  };
+  const int32_t base = lroundf(cnts[0]);
+  if ((base < 0) || (base % 8)) {return -1;}
+  for (int32_t c = 0; c < 7; c++) {
+    if (fabsf(cnts[c] - static_cast<float>(base + c)) > 0.25f) {return -1;}
+  }
+  return base / 8;
+}
+
+/* Same, for the latest sample held by a sensor object */
+template<class Imu>
+int32_t LatestIndex(const Imu &imu) {
+  bfs::MpuCore::Sample s;
+  s.accel_x_mps2 = imu.accel_x_mps2();
+  s.accel_y_mps2 = imu.accel_y_mps2();
+  s.accel_z_mps2 = imu.accel_z_mps2();
+  s.gyro_x_radps = imu.gyro_x_radps();
+  s.gyro_y_radps = imu.gyro_y_radps();
+  s.gyro_z_radps = imu.gyro_z_radps();
+  s.die_temp_c = imu.die_temp_c();
+  return SampleIndex(s, imu.accel_scale_mps2(), imu.gyro_scale_radps());
+}
+
+/* Same, for a 14 byte frame of raw data */
+inline int32_t FrameIndex(const uint8_t * const frame) {
+  int32_t cnts[7];
+  for (int32_t c = 0; c < 7; c++) {
+    cnts[c] = static_cast<int16_t>(frame[2 * c] << 8 | frame[2 * c + 1]);
+  }
+  if ((cnts[0] < 0) || (cnts[0] % 8)) {return -1;}
+  for (int32_t c = 0; c < 7; c++) {
+    if (cnts[c] != cnts[0] + c) {return -1;}
+  }
+  return cnts[0] / 8;
+}
+
+/* Index of the latest sample taken by the simulated sensor */
+inline int32_t SimIndex(const SimMpu &mpu) {
+  return static_cast<int32_t>(mpu.num_samples() % SIM_PERIOD);
+}
+
+/* Prints and counts a failed check */
+inline void Expect(const bool cond, const char * const what,
+                   int * const failures) {
+  if (!cond) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    (*failures)++;
+  }
+}
+
+#endif  // INVENSENSE_IMU_TESTS_HOST_SIM_CHECKS_H_ NOLINT